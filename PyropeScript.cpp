@@ -11,41 +11,312 @@
 * See the License for the specific language governing permissions and
 * limitations under the License.
 */
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <optional>
+#include <sstream>
 #include <string>
 #include <vector>
 
 #include "allocator.hpp"
+#include "lex_stats.hpp"
+#include "mapped_file.hpp"
+#include "parser.hpp"
+#include "token_cache.hpp"
 #include "tokenizer.hpp"
 
 using namespace std;
 
-int main() {
+// Large stdout buffer flushed with fwrite, so printing a token never flushes
+struct OutputBuffer {
+	static constexpr size_t CAPACITY = 1 << 20;
 
-	while (true) {
+	vector<char> buffer;
+	size_t used = 0;
+	FILE* out;
 
-		string source, line = "START";
+	OutputBuffer(FILE* out) : buffer(CAPACITY), out(out) {}
+	~OutputBuffer() {
+		flush();
+	}
 
-		cout << "Source code:\nvvvvvvvvvv" << endl;
+	void flush() {
+		if (used > 0)
+			fwrite(buffer.data(), 1, used, out);
+		used = 0;
+		fflush(out);
+	}
+	void write(string_view text) {
+		if (used + text.size() > buffer.size()) {
+			fwrite(buffer.data(), 1, used, out);
+			used = 0;
+			if (text.size() > buffer.size()) {
+				fwrite(text.data(), 1, text.size(), out);
+				return;
+			}
+		}
+		memcpy(buffer.data() + used, text.data(), text.size());
+		used += text.size();
+	}
+	void put(char c) {
+		if (used == buffer.size()) {
+			fwrite(buffer.data(), 1, used, out);
+			used = 0;
+		}
+		buffer[used++] = c;
+	}
+	void number(size_t value) {
+		char digits[20];
+		size_t count = 0;
+		do {
+			digits[count++] = (char)('0' + value % 10);
+			value /= 10;
+		} while (value > 0);
+		while (count > 0)
+			put(digits[--count]);
+	}
+	// Same format as operator<<(ostream&, Token)
+	void token(TokenType type, string_view lexeme, size_t line, size_t column) {
+		number(line);
+		put(':');
+		number(column);
+		put('\t');
+		write(tokenTypeName(type));
+		write("\t\"");
+		write(lexeme);
+		write("\"\n");
+	}
+	void traceback(const TRACEBACK& tb) {
+		write("Traceback(");
+		write(tb.message);
+		write(" at line ");
+		number(tb.line);
+		write(" column ");
+		number(tb.column);
+		write(")\n");
+	}
+};
 
-		while (getline(cin, line) && line != "END") {
-			source += line + '\n';
+enum class OutputMode {
+	Tokens,		// every token
+	Count,		// token count per file
+	Quiet,		// tracebacks only
+	Ast,		// syntax tree per file
+};
+
+// Tokenizes every file straight from its mapping, returns the exit status.
+// With a cache, files lexed before are loaded from it instead. With
+// all_errors a file with an error is lexed again in recovering mode, so
+// every error of it is reported, not only the first. With stats every file
+// is lexed, never loaded, and what was lexed is reported after the files.
+int lexFiles(const vector<string>& paths, OutputMode mode, const TokenCache* cache, bool all_errors, LexStats* stats) {
+	OutputBuffer out(stdout);
+	SymbolTable symbols;
+	TokenBuffer tokens;
+	Diagnostics diagnostics;
+	Arena arena;
+	Parser parser;
+	MappedFile file;
+	int status = 0;
+
+	for (const string& path : paths) {
+		try {
+			file.open(path);
+		}
+		catch (const runtime_error& e) {
+			out.flush();
+			cerr << e.what() << endl;
+			status = 2;
+			continue;
 		}
 
-		cout << "^^^^^^^^^^^^\n" << endl;
+		NONE_OR_TRACEBACK res = true;
+		try {
+			res = stats != nullptr
+				? tokenizeWithStats(file.view(), tokens, *stats, &symbols, stats->profiled)
+				: cache != nullptr
+				? tokenizeCached(file.view(), tokens, *cache, &symbols)
+				: tokenize(file.view(), tokens, symbols);
+			diagnostics.clear();
+			if (res.is_traceback && all_errors)
+				tokenizeAll(file.view(), tokens, diagnostics, &symbols);
+			else if (res.is_traceback)
+				diagnostics.report(res.error);
+		}
+		catch (const length_error& e) {
+			// over 4 GiB, too large for the 32-bit token offsets
+			out.flush();
+			cerr << path << ": " << e.what() << endl;
+			status = 2;
+			continue;
+		}
 
-		vector<Token> tokens;
-		NONE_OR_TRACEBACK res = tokenize(source, tokens);
-		if (res.is_traceback) {
-			cout << res.error << endl;
+		if (mode == OutputMode::Ast && !res.is_traceback) {
+			arena.reset();
+			Ast ast(arena);
+			res = parser.parse(tokens, ast);
+			if (res.is_traceback)
+				diagnostics.report(res.error);
+			else {
+				ostringstream tree;
+				ast.dump(tree, tokens);
+				if (paths.size() > 1) {
+					out.write("==> ");
+					out.write(path);
+					out.write(" <==\n");
+				}
+				out.write(tree.str());
+			}
 		}
 
-		for (Token token : tokens) {
-			cout << token << endl;
+		if (mode == OutputMode::Tokens) {
+			if (paths.size() > 1) {
+				out.write("==> ");
+				out.write(path);
+				out.write(" <==\n");
+			}
+			// tokens are in source order, so the line only moves forward
+			size_t line = 1;
+			for (size_t i = 0; i < tokens.size(); i++) {
+				uint32_t offset = tokens.offsets[i];
+				while (line < tokens.line_starts.size() && tokens.line_starts[line] <= offset)
+					line++;
+				out.token(tokens.types[i], tokens.lexeme(i), line, offset - tokens.line_starts[line - 1] + 1);
+			}
+		}
+		else if (mode == OutputMode::Count) {
+			out.write(path);
+			out.put('\t');
+			out.number(tokens.size());
+			out.put('\n');
 		}
 
-		cout << "\n\n";
+		for (const TRACEBACK& error : diagnostics.errors) {
+			if (mode != OutputMode::Tokens) {
+				out.write(path);
+				out.write(": ");
+			}
+			out.traceback(error);
+		}
+		if (res.is_traceback)
+			status = max(status, 1);
+	}
+	if (stats != nullptr) {
+		out.flush();
+		stats->text(cout);
+	}
+	return status;
+}
+
+void repl() {
+	// shared by every iteration, so names seen before are not stored again
+	SymbolTable symbols;
+	bool input_closed = false;
+
+	while (!input_closed) {
+
+		cout << "Source code:\nvvvvvvvvvv" << endl;
+
+		// lines are handed to the lexer as they are typed, up to a line reading END
+		string line, pending;
+		size_t pending_pos = 0;
+		bool ended = false;
+		Lexer lexer([&](char* buffer, size_t capacity) -> size_t {
+			while (pending_pos == pending.size()) {
+				if (ended)
+					return 0;
+				if (!getline(cin, line)) {
+					input_closed = ended = true;
+					return 0;
+				}
+				if (line == "END") {
+					ended = true;
+					return 0;
+				}
+				pending = line + '\n';
+				pending_pos = 0;
+			}
+			size_t count = min(capacity, pending.size() - pending_pos);
+			memcpy(buffer, pending.data() + pending_pos, count);
+			pending_pos += count;
+			return count;
+		}, &symbols);
+
+		Token token;
+		while (lexer.next(token)) {
+			cout << token << '\n';
+		}
+		if (lexer.status().is_traceback) {
+			cout << lexer.status().error << '\n';
+		}
+
+		cout << "^^^^^^^^^^^^\n\n" << endl;
+
+	}
+}
+
+// Reports a bad command line, returns the exit status
+int usageError(const string& message) {
+	cerr << "PyropeScript: " << message << "\ntry PyropeScript --help\n";
+	return 2;
+}
+
+int main(int argc, char** argv) {
+	vector<string> paths;
+	OutputMode mode = OutputMode::Tokens;
+	string cache_directory;
+	bool all_errors = false;
+	optional<LexStats> stats;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (arg == "--quiet")
+			mode = OutputMode::Quiet;
+		else if (arg == "--count")
+			mode = OutputMode::Count;
+		else if (arg == "--ast")
+			mode = OutputMode::Ast;
+		else if (arg == "--all-errors")
+			all_errors = true;
+		else if (arg == "--stats") {
+			if (!stats)
+				stats.emplace();
+		}
+		else if (arg == "--profile") {
+			stats.emplace();
+			stats->profiled = true;
+		}
+		else if (arg == "--cache") {
+			if (i + 1 == argc)
+				return usageError("--cache needs a directory");
+			cache_directory = argv[++i];
+		}
+		else if (arg == "--help" || arg == "-h") {
+			cout << "usage: PyropeScript                      interactive mode\n"
+				"       PyropeScript [options] FILE...    tokenize files\n"
+				"  --count      print the number of tokens of every file\n"
+				"  --quiet      print tracebacks only\n"
+				"  --ast        parse every file and print its syntax tree\n"
+				"  --cache DIR  keep the tokens of every file in DIR, keyed by content\n"
+				"  --all-errors go on past an error and report every one of a file\n"
+				"  --stats      report token counts, sizes and lexing time of all files\n"
+				"  --profile    as --stats, with the time of every lexer phase\n"
+				"exit status: 0 ok, 1 traceback, 2 unreadable file or bad usage\n";
+			return 0;
+		}
+		else if (arg.size() > 1 && arg[0] == '-')
+			return usageError("unknown option " + arg);
+		else
+			paths.push_back(arg);
+	}
 
+	if (paths.empty()) {
+		repl();
+		return 0;
 	}
-	return 0;
-}
\ No newline at end of file
+	if (cache_directory.empty())
+		return lexFiles(paths, mode, nullptr, all_errors, stats ? &*stats : nullptr);
+	TokenCache cache(cache_directory);
+	return lexFiles(paths, mode, &cache, all_errors, stats ? &*stats : nullptr);
+}
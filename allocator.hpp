@@ -14,55 +14,473 @@
 #pragma once
 
 #include "memory.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
 #include <memory>
+#include <mutex>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
 #include <vector>
-#include <unordered_set>
 
 #include <iostream>
 #include <stdexcept>
 
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
 using namespace std;
 
+// Size classes of SlabHeap: 16-byte steps up to 128, then four classes per
+// power of two up to 4096. Slabs and large blocks start at SLAB_ALIGNMENT,
+// so every block does.
+inline constexpr size_t SLAB_CLASS_COUNT = 28;
+inline constexpr size_t SLAB_MAX_BLOCK = 4096;
+inline constexpr size_t SLAB_ALIGNMENT = 16;
+
+constexpr size_t slabClassSize(size_t size_class) {
+    if (size_class < 8)
+        return (size_class + 1) * 16;
+    return (5 + (size_class - 8) % 4) << ((size_class - 8) / 4 + 5);
+}
+static_assert(slabClassSize(SLAB_CLASS_COUNT - 1) == SLAB_MAX_BLOCK, "the last class must be SLAB_MAX_BLOCK");
+
+// Class of every size rounded up to 16 bytes
+struct SlabClassTable {
+    uint8_t classes[SLAB_MAX_BLOCK / 16 + 1] = {};
+
+    constexpr SlabClassTable() {
+        size_t size_class = 0;
+        for (size_t i = 0; i <= SLAB_MAX_BLOCK / 16; i++) {
+            while (slabClassSize(size_class) < i * 16)
+                size_class++;
+            classes[i] = (uint8_t)size_class;
+        }
+    }
+};
+inline constexpr SlabClassTable SLAB_CLASSES = SlabClassTable();
+
+// Instrumentation of the heap and the pool, compiled in with
+// -DPYROPE_ALLOCATOR_STATS; without it the counters and their updates do
+// not exist. -DPYROPE_ALLOCATOR_DEBUG adds the allocation site of every
+// Allocator entry and reports the entries still referenced when their
+// Allocator is destroyed.
+#if defined(PYROPE_ALLOCATOR_DEBUG) && !defined(PYROPE_ALLOCATOR_STATS)
+#define PYROPE_ALLOCATOR_STATS 1
+#endif
+#ifdef PYROPE_ALLOCATOR_STATS
+#define PYROPE_ALLOCATOR_STAT(...) __VA_ARGS__
+#else
+#define PYROPE_ALLOCATOR_STAT(...)
+#endif
+#ifdef PYROPE_ALLOCATOR_DEBUG
+#define PYROPE_ALLOCATOR_DEBUG_ONLY(...) __VA_ARGS__
+#define PYROPE_ALLOCATION_SITE , const char* site_file = __builtin_FILE(), unsigned site_line = __builtin_LINE()
+#define PYROPE_ALLOCATION_SITE_ARGS , site_file, site_line
+#else
+#define PYROPE_ALLOCATOR_DEBUG_ONLY(...)
+#define PYROPE_ALLOCATION_SITE
+#define PYROPE_ALLOCATION_SITE_ARGS
+#endif
+
+#ifdef PYROPE_ALLOCATOR_STATS
+// Counters of the slab heaps of all threads
+struct SlabStats {
+    static constexpr size_t LARGE = SLAB_CLASS_COUNT;  // blocks above SLAB_MAX_BLOCK
+
+    atomic<uint64_t> allocations[SLAB_CLASS_COUNT + 1] = {};
+    atomic<uint64_t> frees[SLAB_CLASS_COUNT + 1] = {};
+    atomic<uint64_t> live_bytes = 0;        // requested by the blocks in use
+    atomic<uint64_t> slab_bytes = 0;        // slabs carved by SlabCentral
+    atomic<uint64_t> large_bytes = 0;       // large blocks in use
+    atomic<uint64_t> grows = 0;             // RawMemory::realloc_ to a bigger size
+    atomic<uint64_t> shrinks = 0;
+    atomic<uint64_t> resized_in_place = 0;  // reallocations that kept their block
+    atomic<uint64_t> shared_copies = 0;     // RawMemory copies sharing a block
+    atomic<uint64_t> unshared = 0;          // shared blocks copied on a mutation
+
+    void add(atomic<uint64_t>& counter, int64_t delta) {
+        counter.fetch_add((uint64_t)delta, memory_order_relaxed);
+    }
+    void allocated(size_t size_class, size_t size) {
+        add(allocations[size_class], 1);
+        add(live_bytes, (int64_t)size);
+        if (size_class == LARGE)
+            add(large_bytes, (int64_t)size);
+    }
+    void freed(size_t size_class, size_t size) {
+        add(frees[size_class], 1);
+        add(live_bytes, -(int64_t)size);
+        if (size_class == LARGE)
+            add(large_bytes, -(int64_t)size);
+    }
+    // A block resized without moving to another class
+    void resized(size_t size_class, size_t old_size, size_t new_size) {
+        add(resized_in_place, 1);
+        add(live_bytes, (int64_t)new_size - (int64_t)old_size);
+        if (size_class == LARGE)
+            add(large_bytes, (int64_t)new_size - (int64_t)old_size);
+    }
+};
+
+// Never destroyed, like slabCentral()
+inline SlabStats& slabStats() {
+    static SlabStats* stats = new SlabStats();
+    return *stats;
+}
+#endif
+
+struct SlabBlock {
+    SlabBlock* next;
+};
+
+// Slabs and the free blocks shared by the thread caches. Blocks move
+// between a cache and here in batches, so the lock is taken once for many
+// allocations. Slabs are kept for the life of the process.
+class SlabCentral {
+public:
+    static constexpr size_t SLAB_SIZE = 64 * 1024;
+
+    struct Batch {
+        SlabBlock* head = nullptr;
+        size_t count = 0;
+    };
+
+    // A batch of up to count free blocks of size_class, carved from a new
+    // slab when no freed ones are left
+    Batch take(size_t size_class, size_t count) {
+        lock_guard<mutex> hold(lock);
+        vector<Batch>& freed = batches[size_class];
+        if (!freed.empty()) {
+            Batch batch = freed.back();
+            freed.pop_back();
+            return batch;
+        }
+        size_t block_size = slabClassSize(size_class);
+        Batch batch;
+        for (; batch.count < count; batch.count++) {
+            if (unused[size_class] == unused_end[size_class]) {
+                slabs.emplace_back(new Slab);
+                PYROPE_ALLOCATOR_STAT(slabStats().add(slabStats().slab_bytes, SLAB_SIZE));
+                unused[size_class] = slabs.back()->bytes;
+                unused_end[size_class] = unused[size_class] + SLAB_SIZE / block_size * block_size;
+            }
+            SlabBlock* block = (SlabBlock*)unused[size_class];
+            unused[size_class] += block_size;
+            block->next = batch.head;
+            batch.head = block;
+        }
+        return batch;
+    }
+    void give(size_t size_class, Batch batch) {
+        lock_guard<mutex> hold(lock);
+        batches[size_class].push_back(batch);
+    }
+
+private:
+    struct alignas(SLAB_ALIGNMENT) Slab {
+        char bytes[SLAB_SIZE];
+    };
+
+    mutex lock;
+    vector<Batch> batches[SLAB_CLASS_COUNT];
+    char* unused[SLAB_CLASS_COUNT] = {};        // uncarved rest of the newest slab of each class
+    char* unused_end[SLAB_CLASS_COUNT] = {};
+    vector<unique_ptr<Slab>> slabs;
+};
+
+// Never destroyed, so blocks may be released during exit
+inline SlabCentral& slabCentral() {
+    static SlabCentral* central = new SlabCentral();
+    return *central;
+}
+
+// Size-class heap behind RawMemory, one per thread. Blocks up to MAX_BLOCK
+// bytes are recycled through intrusive free lists, so a freed block is
+// reused by the next allocation of its class without a lock or malloc.
+// A list refills from SlabCentral when empty and gives a batch back when it
+// holds two. A block may be released by another thread than the one that
+// allocated it. Bigger blocks go to malloc directly, or _aligned_malloc on
+// Windows, whose malloc only aligns to 8 bytes on 32-bit targets.
+class SlabHeap {
+public:
+    static constexpr size_t MAX_BLOCK = SLAB_MAX_BLOCK;
+    static constexpr size_t CLASS_COUNT = SLAB_CLASS_COUNT;
+
+    // Smallest class that holds size bytes; size must be at most MAX_BLOCK
+    static size_t classOf(size_t size) {
+        return SLAB_CLASSES.classes[(size + 15) / 16];
+    }
+    // Blocks moved to or from SlabCentral at once: 16 KiB worth, 8 to 64
+    static constexpr size_t batchSize(size_t size_class) {
+        size_t count = 16384 / slabClassSize(size_class);
+        return count < 8 ? 8 : count > 64 ? 64 : count;
+    }
+
+    void* allocate(size_t size) {
+        if (size > MAX_BLOCK) {
+            void* block = largeAllocate(size);
+            if (block == nullptr)
+                throw std::bad_alloc();
+            PYROPE_ALLOCATOR_STAT(slabStats().allocated(SlabStats::LARGE, size));
+            return block;
+        }
+        size_t size_class = classOf(size);
+        if (free_lists[size_class] == nullptr)
+            refill(size_class);
+        SlabBlock* block = free_lists[size_class];
+        free_lists[size_class] = block->next;
+        counts[size_class]--;
+        PYROPE_ALLOCATOR_STAT(slabStats().allocated(size_class, size));
+        return block;
+    }
+    // size is the one the block was allocated or last reallocated with
+    void release(void* block, size_t size) {
+        if (size > MAX_BLOCK) {
+            largeRelease(block);
+            PYROPE_ALLOCATOR_STAT(slabStats().freed(SlabStats::LARGE, size));
+            return;
+        }
+        size_t size_class = classOf(size);
+        PYROPE_ALLOCATOR_STAT(slabStats().freed(size_class, size));
+        SlabBlock* freed = (SlabBlock*)block;
+        freed->next = free_lists[size_class];
+        free_lists[size_class] = freed;
+        if (++counts[size_class] >= limit(size_class))
+            flush(size_class, retired ? counts[size_class] : batchSize(size_class));
+    }
+    // Keeps the block while the new size stays in its class
+    void* reallocate(void* block, size_t old_size, size_t new_size) {
+        if (block == nullptr)
+            return allocate(new_size);
+        if (old_size > MAX_BLOCK && new_size > MAX_BLOCK) {
+            void* moved = largeResize(block, new_size);
+            if (moved == nullptr)
+                throw std::bad_alloc();
+            PYROPE_ALLOCATOR_STAT(slabStats().resized(SlabStats::LARGE, old_size, new_size));
+            return moved;
+        }
+        if (old_size <= MAX_BLOCK && new_size <= MAX_BLOCK && classOf(old_size) == classOf(new_size)) {
+            PYROPE_ALLOCATOR_STAT(slabStats().resized(classOf(old_size), old_size, new_size));
+            return block;
+        }
+        void* moved = allocate(new_size);
+        memcpy(moved, block, old_size < new_size ? old_size : new_size);
+        release(block, old_size);
+        return moved;
+    }
+
+    // Gives every cached block back; called when the thread exits. Blocks
+    // released afterwards go straight back too.
+    void retire() {
+        for (size_t size_class = 0; size_class < CLASS_COUNT; size_class++)
+            if (counts[size_class] > 0)
+                flush(size_class, counts[size_class]);
+        retired = true;
+    }
+
+private:
+    SlabBlock* free_lists[CLASS_COUNT] = {};
+    uint32_t counts[CLASS_COUNT] = {};
+    bool retired = false;
+
+    struct Retirer {
+        ~Retirer();
+    };
+
+    static void* largeAllocate(size_t size) {
+#ifdef _WIN32
+        return _aligned_malloc(size, SLAB_ALIGNMENT);
+#else
+        return malloc(size);
+#endif
+    }
+    static void* largeResize(void* block, size_t size) {
+#ifdef _WIN32
+        return _aligned_realloc(block, size, SLAB_ALIGNMENT);
+#else
+        return realloc(block, size);
+#endif
+    }
+    static void largeRelease(void* block) {
+#ifdef _WIN32
+        _aligned_free(block);
+#else
+        free(block);
+#endif
+    }
+    uint32_t limit(size_t size_class) const {
+        return retired ? 1 : (uint32_t)(2 * batchSize(size_class));
+    }
+    void refill(size_t size_class) {
+        // registers retire() at the exit of the thread
+        thread_local Retirer retirer;
+        (void)retirer;
+        SlabCentral::Batch batch = slabCentral().take(size_class, retired ? 1 : batchSize(size_class));
+        free_lists[size_class] = batch.head;
+        counts[size_class] = (uint32_t)batch.count;
+    }
+    void flush(size_t size_class, size_t count) {
+        SlabCentral::Batch batch;
+        batch.head = free_lists[size_class];
+        SlabBlock* last = batch.head;
+        for (batch.count = 1; batch.count < count; batch.count++)
+            last = last->next;
+        free_lists[size_class] = last->next;
+        last->next = nullptr;
+        counts[size_class] -= (uint32_t)count;
+        slabCentral().give(size_class, batch);
+    }
+};
+
+// The heap of the calling thread. Trivially destructible, so it stays
+// usable by objects released after the thread's destructors have run.
+inline SlabHeap& slabHeap() {
+    thread_local SlabHeap heap;
+    return heap;
+}
+
+inline SlabHeap::Retirer::~Retirer() {
+    slabHeap().retire();
+}
+
+// Payloads of up to INLINE_SIZE bytes, the scalars, live in the record
+// itself and data points at them; larger ones are SlabHeap blocks.
+//
+// A copy of a larger payload shares its block, whose header counts the
+// values sharing it, so passing a string or list by value costs no copy.
+// The first mutation through fill, realloc_ or mdata gives the value a
+// block of its own, so payloads are read through cdata() and written
+// through mdata(). Every payload is aligned to PAYLOAD_ALIGNMENT bytes,
+// enough for any scalar.
 struct RawMemory {
+    // ref_count of an entry claimed by a collector
+    static constexpr size_t DEAD = SIZE_MAX;
+    static constexpr size_t INLINE_SIZE = 16;
+    static constexpr size_t PAYLOAD_ALIGNMENT = SLAB_ALIGNMENT;
+
+    // Precedes the payload in its block, padded to keep it aligned
+    struct alignas(PAYLOAD_ALIGNMENT) SharedHeader {
+        atomic<size_t> owners;
+    };
+    static constexpr size_t HEADER_SIZE = sizeof(SharedHeader);
+    static_assert(HEADER_SIZE % PAYLOAD_ALIGNMENT == 0, "the header must keep the payload aligned");
+
+private:
 	void* data  = nullptr;
+public:
 	size_t size = 0;
-	size_t ref_count = 0;
+	atomic<size_t> ref_count = 0;
+    alignas(PAYLOAD_ALIGNMENT) unsigned char small[INLINE_SIZE];
 
 	RawMemory() {}
     RawMemory(size_t size) : size(size) {
         this->realloc_(size);
     }
+    // Shares the block of other; the reference count is not copied
 	RawMemory(const RawMemory& other) : size(other.size) {
-        this->realloc_(size);
-        if (this->data != nullptr)
-		    memcpy(this->data, other.data, size);
+        share(other);
 	}
+    // Moves keep the block and the reference count, so the pool can grow
+    // without copying every payload
+    RawMemory(RawMemory&& other) noexcept
+        : data(other.data), size(other.size), ref_count(other.ref_count.load(memory_order_relaxed)) {
+        if (other.isInline()) {
+            data = small;
+            memcpy(small, other.small, size);
+        }
+        other.data = nullptr;
+        other.size = 0;
+        other.ref_count.store(0, memory_order_relaxed);
+    }
+    RawMemory& operator=(const RawMemory& other) {
+        if (this != &other && !(data == other.data && size == other.size)) {
+            free_();
+            size = other.size;
+            share(other);
+        }
+        return *this;
+    }
+    RawMemory& operator=(RawMemory&& other) noexcept {
+        if (this != &other) {
+            free_();
+            data = other.data;
+            size = other.size;
+            ref_count.store(other.ref_count.load(memory_order_relaxed), memory_order_relaxed);
+            if (other.isInline()) {
+                data = small;
+                memcpy(small, other.small, size);
+            }
+            other.data = nullptr;
+            other.size = 0;
+            other.ref_count.store(0, memory_order_relaxed);
+        }
+        return *this;
+    }
     ~RawMemory() {
-        if (data != nullptr && size > 0)
-            free(data);
+        if (data != nullptr && !isInline())
+            releaseBlock();
+    }
+    bool isInline() const {
+        return data == small;
+    }
+    // Whether other values read the same block
+    bool isShared() const {
+        return data != nullptr && !isInline() && header()->owners.load(memory_order_acquire) > 1;
     }
+    // Moves the payload in or out of the record when new_size crosses
+    // INLINE_SIZE. A shared payload is copied into a block of new_size.
     void realloc_(size_t new_size) {
-       if (this->data != nullptr) {
-           void* temp = realloc(data, new_size);
-           if (temp == nullptr) {
-               throw std::bad_alloc();
-           }
-           data = temp;
-       }
-       else {
-           data = malloc(new_size);
-           if (data == nullptr) {
-               throw std::bad_alloc();
-           }
-       }
-       size = new_size;
+        PYROPE_ALLOCATOR_STAT(if (data != nullptr && new_size != size)
+            slabStats().add(new_size > size ? slabStats().grows : slabStats().shrinks, 1));
+        if (new_size <= INLINE_SIZE) {
+            if (data != nullptr && !isInline()) {
+                memcpy(small, data, new_size < size ? new_size : size);
+                releaseBlock();
+            }
+            data = small;
+        }
+        else if (data != nullptr && !isInline() && header()->owners.load(memory_order_acquire) == 1) {
+            void* block = slabHeap().reallocate(header(), size + HEADER_SIZE, new_size + HEADER_SIZE);
+            data = (char*)block + HEADER_SIZE;
+        }
+        else {
+            void* payload = allocateBlock(new_size);
+            if (data != nullptr)
+                memcpy(payload, data, size < new_size ? size : new_size);
+            if (data != nullptr && !isInline()) {
+                PYROPE_ALLOCATOR_STAT(slabStats().add(slabStats().unshared, 1));
+                releaseBlock();
+            }
+            data = payload;
+        }
+        size = new_size;
+    }
+    // The payload for writing, copied first if it is shared
+    void* mdata() {
+        if (isShared()) {
+            PYROPE_ALLOCATOR_STAT(slabStats().add(slabStats().unshared, 1));
+            void* payload = allocateBlock(size);
+            memcpy(payload, data, size);
+            releaseBlock();
+            data = payload;
+        }
+        return data;
     }
     const void* cdata() const {
         return data;
     }
     void fill(uint8_t value) {
 		if (data != nullptr && size > 0) {
-			memset(data, value, size);
+			memset(mdata(), value, size);
 		}
     }
     void hex(ostream& os) const {
@@ -92,6 +510,7 @@ struct RawMemory {
 	inline bool operator!=(const RawMemory& other) const {
 		return (this->size != other.size) || (this->data != other.data);
 	}
+    // Values sharing a block are equal without comparing it
     bool same_as(const RawMemory& other) const {
         if (*this == other)
             return true;
@@ -100,64 +519,685 @@ struct RawMemory {
 		return memcmp(this->data, other.data, this->size) == 0;
     }
     void free_() {
-        if (data != nullptr && size > 0) {
-			free(data);
+        if (data != nullptr) {
+            if (!isInline())
+			    releaseBlock();
 			data = nullptr;
 			size = 0;
 		}
     }
     void operator++() {
-        ref_count++;
+        ref_count.fetch_add(1, memory_order_relaxed);
     }
     void operator--() {
-        if (ref_count > 0)
-            ref_count--;
-        if (ref_count < 1)
+        if (drop() == 0)
             free_();
     }
+    // Decrements a positive count without freeing; returns the new count
+    size_t drop() {
+        size_t count = ref_count.load(memory_order_relaxed);
+        while (count > 0 && count != DEAD
+            && !ref_count.compare_exchange_weak(count, count - 1, memory_order_acq_rel, memory_order_relaxed)) {}
+        return count > 0 && count != DEAD ? count - 1 : count;
+    }
+
+private:
+    SharedHeader* header() const {
+        return (SharedHeader*)((char*)data - HEADER_SIZE);
+    }
+    // A block owned by this value alone; returns its payload
+    static void* allocateBlock(size_t size) {
+        void* block = slabHeap().allocate(size + HEADER_SIZE);
+        new (block) SharedHeader{ 1 };
+        return (char*)block + HEADER_SIZE;
+    }
+    // Drops this value's share of the block, freeing it with the last one
+    void releaseBlock() {
+        SharedHeader* shared = header();
+        if (shared->owners.load(memory_order_acquire) == 1 || shared->owners.fetch_sub(1, memory_order_acq_rel) == 1)
+            slabHeap().release(shared, size + HEADER_SIZE);
+    }
+    // Takes the payload of other, with size already set
+    void share(const RawMemory& other) {
+        if (other.data == nullptr)
+            data = nullptr;
+        else if (other.isInline()) {
+            data = small;
+            memcpy(small, other.small, size);
+        }
+        else {
+            data = other.data;
+            header()->owners.fetch_add(1, memory_order_relaxed);
+            PYROPE_ALLOCATOR_STAT(slabStats().add(slabStats().shared_copies, 1));
+        }
+    }
+};
+
+// Reference to an Allocator entry. Every time an entry is freed its slot
+// moves to the next generation, which tells a handle kept from before the
+// reuse of the slot from the handles of its new value.
+struct MemoryHandle {
+    static constexpr uint32_t NO_INDEX = UINT32_MAX;
+
+    uint32_t index = NO_INDEX;
+    uint32_t generation = 0;
+
+    inline bool operator==(const MemoryHandle& other) const {
+        return index == other.index && generation == other.generation;
+    }
+    inline bool operator!=(const MemoryHandle& other) const {
+        return !(*this == other);
+    }
 };
 
+// Debug builds check every handle passed to Allocator::get
+#ifdef NDEBUG
+inline constexpr bool CHECK_MEMORY_HANDLES = false;
+#else
+inline constexpr bool CHECK_MEMORY_HANDLES = true;
+#endif
+
+#ifdef PYROPE_ALLOCATOR_STATS
+// Snapshot of Allocator::stats(). The heap counters cover the slab heaps of
+// all threads; the pool ones a single Allocator.
+struct AllocatorStats {
+    static constexpr size_t LARGE = SLAB_CLASS_COUNT;
+
+    // slab heaps
+    uint64_t class_allocations[SLAB_CLASS_COUNT + 1] = {};  // the last counts blocks above SLAB_MAX_BLOCK
+    uint64_t class_frees[SLAB_CLASS_COUNT + 1] = {};
+    uint64_t heap_live_bytes = 0;       // requested by the blocks in use
+    uint64_t heap_reserved_bytes = 0;   // slabs and large blocks
+    uint64_t grows = 0;
+    uint64_t shrinks = 0;
+    uint64_t resized_in_place = 0;
+    uint64_t shared_copies = 0;
+    uint64_t unshared = 0;
+    // pool
+    uint64_t slots = 0;
+    uint64_t free_slots = 0;
+    uint64_t live_entries = 0;
+    uint64_t inline_entries = 0;        // payloads kept in the RawMemory record
+    uint64_t referenced_entries = 0;
+    uint64_t live_bytes = 0;            // payloads of the live entries
+    uint64_t allocations = 0;
+    uint64_t reclaimed_entries = 0;
+    uint64_t reclaimed_bytes = 0;
+    uint64_t full_gcs = 0;
+    uint64_t gc_steps = 0;
+    uint64_t gc_nanoseconds = 0;
+    uint64_t gc_max_pause_nanoseconds = 0;
+
+    void collected(chrono::steady_clock::time_point started) {
+        uint64_t pause = (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - started).count();
+        gc_nanoseconds += pause;
+        if (pause > gc_max_pause_nanoseconds)
+            gc_max_pause_nanoseconds = pause;
+    }
+    // Share of the reserved heap bytes not holding live payloads
+    double fragmentation() const {
+        return heap_reserved_bytes == 0 ? 0 : 1 - (double)heap_live_bytes / (double)heap_reserved_bytes;
+    }
+
+    void json(ostream& os) const {
+        os << "{\"pool\":{\"slots\":" << slots << ",\"free_slots\":" << free_slots
+            << ",\"live_entries\":" << live_entries << ",\"inline_entries\":" << inline_entries
+            << ",\"referenced_entries\":" << referenced_entries << ",\"live_bytes\":" << live_bytes
+            << ",\"allocations\":" << allocations << ",\"reclaimed_entries\":" << reclaimed_entries
+            << ",\"reclaimed_bytes\":" << reclaimed_bytes << "},"
+            << "\"gc\":{\"full\":" << full_gcs << ",\"steps\":" << gc_steps
+            << ",\"nanoseconds\":" << gc_nanoseconds << ",\"max_pause_nanoseconds\":" << gc_max_pause_nanoseconds << "},"
+            << "\"heap\":{\"live_bytes\":" << heap_live_bytes << ",\"reserved_bytes\":" << heap_reserved_bytes
+            << ",\"fragmentation\":" << fragmentation()
+            << ",\"grows\":" << grows << ",\"shrinks\":" << shrinks << ",\"resized_in_place\":" << resized_in_place
+            << ",\"shared_copies\":" << shared_copies << ",\"unshared\":" << unshared
+            << ",\"classes\":[";
+        for (size_t i = 0; i <= LARGE; i++) {
+            os << (i > 0 ? "," : "") << "{\"size\":";
+            if (i == LARGE)
+                os << "null";
+            else
+                os << slabClassSize(i);
+            os << ",\"allocations\":" << class_allocations[i] << ",\"frees\":" << class_frees[i] << "}";
+        }
+        os << "]}}";
+    }
+    void text(ostream& os) const {
+        os << "pool: " << slots << " slots, " << free_slots << " free, " << live_entries << " live ("
+            << inline_entries << " inline, " << referenced_entries << " referenced), " << live_bytes << " bytes\n"
+            << "      " << allocations << " allocations, " << reclaimed_entries << " reclaimed, "
+            << reclaimed_bytes << " bytes\n"
+            << "gc:   " << full_gcs << " full, " << gc_steps << " steps, " << gc_nanoseconds / 1000 << " us, max pause "
+            << gc_max_pause_nanoseconds / 1000 << " us\n"
+            << "heap: " << heap_live_bytes << " of " << heap_reserved_bytes << " reserved bytes live, "
+            << (int)(fragmentation() * 100) << "% fragmentation\n"
+            << "      " << grows << " grows, " << shrinks << " shrinks, " << resized_in_place << " in place\n"
+            << "      " << shared_copies << " shared copies, " << unshared << " unshared\n";
+        for (size_t i = 0; i <= LARGE; i++) {
+            if (class_allocations[i] == 0 && class_frees[i] == 0)
+                continue;
+            os << "      ";
+            if (i == LARGE)
+                os << "large";
+            else
+                os << slabClassSize(i);
+            os << ": " << class_allocations[i] << " allocations, " << class_frees[i] << " frees\n";
+        }
+    }
+};
+#endif
+
+#ifdef PYROPE_ALLOCATOR_DEBUG
+struct AllocationSite {
+    const char* file = nullptr;
+    unsigned line = 0;
+};
+#endif
+
+inline unsigned highestBit(uint64_t value) {
+#if defined(_MSC_VER) && !defined(__clang__) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return (unsigned)index;
+#elif defined(_MSC_VER) && !defined(__clang__)
+    // 32-bit targets have no 64-bit scan: try the high half, then the low
+    unsigned long index;
+    if (_BitScanReverse(&index, (unsigned long)(value >> 32)))
+        return (unsigned)index + 32;
+    _BitScanReverse(&index, (unsigned long)value);
+    return (unsigned)index;
+#else
+    return 63 - (unsigned)__builtin_clzll(value);
+#endif
+}
+
+// Pool of reference-counted entries. Slots live in chunks that never move,
+// each twice the size of the one before, so a RawMemory& from ialloc stays
+// valid while the pool grows and a handle is resolved without a lock.
+// Freed slots form an intrusive stack and are reused last in, first out,
+// while their memory is still in cache.
+//
+// gc() scans the whole pool. The incremental collector instead works
+// through the entries that may have become garbage: those released to a
+// zero count through release(), and, when generational, the young entries
+// allocated since they were last looked at. A young entry still referenced
+// when it is looked at is promoted to the old generation and not visited
+// again unless it is released. Generational tracking is opt-in: the young
+// queue is only drained by the collectors, so it would grow without end
+// under code that allocates and never collects. The released queue holds
+// an entry at most once, however often it drops to zero before a collector
+// gets to it. Entries dropped with RawMemory::operator-- directly are only
+// found by gc().
+//
+// A concurrent allocator may be shared by threads: alloc, retain, release
+// and the collectors may run at the same time. The pool is guarded by a
+// lock, the payloads come from the per-thread slab caches, and a collector
+// claims an entry by moving its count from 0 to DEAD, so an entry is either
+// retained or freed, never both. Entries must then be dropped with
+// release(), as RawMemory::operator-- frees the payload itself.
+//
+// With PYROPE_ALLOCATOR_STATS stats() reports the counters of the pool and
+// the heap; with PYROPE_ALLOCATOR_DEBUG the destructor lists the entries
+// still referenced and where they were allocated.
 struct Allocator {
-    vector<RawMemory> memory_pool;
-    unordered_set<size_t> free_pool;
+    static constexpr size_t FIRST_CHUNK = 1024;     // slots of the first chunk
+    static constexpr size_t CHUNK_LEVELS = 23;      // enough chunks for 2^32 slots
+    static constexpr uint32_t NO_SLOT = UINT32_MAX;
+    static constexpr size_t GC_SLICE = 256;         // entries per gcFor step
+
+    struct Slot {
+        RawMemory memory;
+        atomic<uint32_t> generation = 0;
+        atomic<bool> is_free = false;
+        uint32_t next_free = NO_SLOT;   // next slot of the free stack
+        bool queued = false;            // in released; changed under the pool lock
+    };
+
+    const bool concurrent;
+    atomic<Slot*> chunks[CHUNK_LEVELS] = {};
+    atomic<size_t> slot_count = 0;
+    uint32_t free_top = NO_SLOT;    // last freed slot
+    size_t free_count = 0;
+    bool generational = false;      // track young entries for gcStep
+    vector<MemoryHandle> released;  // released to zero, maybe garbage
+    vector<MemoryHandle> young;     // allocated since the last step that saw them
 
-    Allocator() {}
+    explicit Allocator(bool concurrent = false) : concurrent(concurrent) {}
+    Allocator(const Allocator&) = delete;
+    Allocator& operator=(const Allocator&) = delete;
     ~Allocator() {
-        for (size_t i=0; i < memory_pool.size(); i++)
-			memory_pool[i].free_();
+        PYROPE_ALLOCATOR_DEBUG_ONLY(reportLeaks(cerr));
+        for (atomic<Slot*>& chunk : chunks)
+            delete[] chunk.load();
     }
-    
+
+    // Adds size free slots; the lowest of them is reused first
     void reserve(size_t size) {
-        size_t prev_size = memory_pool.size();
-        memory_pool.reserve(prev_size + size);
-        for (size_t i = 0; i < size; i++) {
-            memory_pool.push_back(RawMemory());
-            free_pool.insert(prev_size + i);
+        unique_lock<mutex> hold = guard();
+        size_t first = slot_count;
+        for (size_t i = 0; i < size; i++)
+            newSlot();
+        for (size_t i = slot_count; i > first; i--)
+            pushFree((uint32_t)(i - 1));
+    }
+    // An entry of size bytes referenced references times. Threads sharing
+    // a concurrent allocator pass 1, as a collector may free an entry with
+    // no references before it is retained.
+    MemoryHandle alloc(size_t size, size_t references = 0 PYROPE_ALLOCATION_SITE) {
+        unique_lock<mutex> hold = guard();
+        PYROPE_ALLOCATOR_STAT(counters.allocations++);
+        uint32_t index = free_top;
+        if (index != NO_SLOT) {
+            Slot& slot = this->slot(index);
+            free_top = slot.next_free;
+            free_count--;
+            slot.next_free = NO_SLOT;
+            slot.memory.realloc_(size);
+            slot.memory.ref_count.store(references, memory_order_relaxed);
+            slot.is_free.store(false, memory_order_release);
+            PYROPE_ALLOCATOR_DEBUG_ONLY(sites[index] = { site_file, site_line });
+            return track({ index, slot.generation.load(memory_order_relaxed) });
         }
+        index = newSlot();
+        Slot& slot = this->slot(index);
+        slot.memory.realloc_(size);
+        slot.memory.ref_count.store(references, memory_order_relaxed);
+        PYROPE_ALLOCATOR_DEBUG_ONLY(sites[index] = { site_file, site_line });
+        return track({ index, slot.generation.load(memory_order_relaxed) });
     }
-    size_t alloc(size_t size) {
-        if (free_pool.empty()) {
-            memory_pool.push_back(RawMemory(size));
-            return memory_pool.size() - 1;
+    RawMemory& ialloc(size_t size PYROPE_ALLOCATION_SITE) {
+        return slot(alloc(size, 0 PYROPE_ALLOCATION_SITE_ARGS).index).memory;
+    }
+
+    // Whether handle refers to the current value of its slot
+    bool live(MemoryHandle handle) const {
+        if (handle.index >= slot_count.load(memory_order_acquire))
+            return false;
+        const Slot& slot = this->slot(handle.index);
+        return !slot.is_free.load(memory_order_acquire)
+            && slot.generation.load(memory_order_relaxed) == handle.generation;
+    }
+    RawMemory& get(MemoryHandle handle) {
+        if (CHECK_MEMORY_HANDLES && !live(handle))
+            throw invalid_argument("Allocator: stale memory handle");
+        return slot(handle.index).memory;
+    }
+    const RawMemory& get(MemoryHandle handle) const {
+        if (CHECK_MEMORY_HANDLES && !live(handle))
+            throw invalid_argument("Allocator: stale memory handle");
+        return slot(handle.index).memory;
+    }
+
+    // Adds a reference; throws if a collector has already freed the entry
+    void retain(MemoryHandle handle) {
+        atomic<size_t>& count = get(handle).ref_count;
+        size_t seen = count.load(memory_order_relaxed);
+        if (!concurrent && seen != RawMemory::DEAD) {
+            count.store(seen + 1, memory_order_relaxed);
+            return;
         }
-        else {
-            size_t index = *free_pool.begin();
-            free_pool.erase(free_pool.begin());
-            memory_pool[index].realloc_(size);
-            return index;
+        do {
+            if (seen == RawMemory::DEAD)
+                throw invalid_argument("Allocator: stale memory handle");
+        } while (!count.compare_exchange_weak(seen, seen + 1, memory_order_relaxed));
+    }
+    // Drops a reference; an entry left unreferenced is queued for gcStep
+    void release(MemoryHandle handle) {
+        RawMemory& memory = get(handle);
+        size_t left = memory.ref_count.load(memory_order_relaxed);
+        if (concurrent)
+            left = memory.drop();
+        else if (left > 0 && left != RawMemory::DEAD)
+            memory.ref_count.store(--left, memory_order_relaxed);
+        if (left == 0) {
+            unique_lock<mutex> hold = guard();
+            Slot& slot = this->slot(handle.index);
+            if (!slot.queued) {
+                slot.queued = true;
+                released.push_back(handle);
+            }
         }
     }
-    RawMemory& ialloc(size_t size) {
-        size_t index = alloc(size);
-        return memory_pool[index];
+
+    size_t size() const {
+        return slot_count.load(memory_order_acquire);
+    }
+    Slot& slot(size_t index) {
+        size_t position = index + FIRST_CHUNK;
+        unsigned level = highestBit(position) - 10;
+        return chunks[level].load(memory_order_acquire)[position - (FIRST_CHUNK << level)];
     }
+    const Slot& slot(size_t index) const {
+        return const_cast<Allocator*>(this)->slot(index);
+    }
+
+    // Full collection: frees every unreferenced entry of the pool
     void gc() {
-        for (size_t i = 0; i < memory_pool.size(); i++) {
-            if (memory_pool[i].ref_count == 0) {
-                memory_pool[i].free_();
-                free_pool.insert(i);
+        unique_lock<mutex> hold = guard();
+        PYROPE_ALLOCATOR_STAT(auto started = chrono::steady_clock::now());
+        size_t count = slot_count.load(memory_order_relaxed);
+        for (size_t level = 0, first = 0; first < count; first += FIRST_CHUNK << level, level++) {
+            Slot* chunk = chunks[level].load(memory_order_relaxed);
+            size_t end = min(count - first, FIRST_CHUNK << level);
+            for (size_t i = 0; i < end; i++)
+                if (!chunk[i].is_free.load(memory_order_relaxed))
+                    claim(chunk[i], (uint32_t)(first + i));
+        }
+        for (MemoryHandle handle : released)
+            slot(handle.index).queued = false;
+        released.clear();
+        young.clear();
+        PYROPE_ALLOCATOR_STAT(counters.full_gcs++, counters.collected(started));
+    }
+    // Looks at up to budget queued entries, released ones first, and frees
+    // the unreferenced ones. Returns how many were freed.
+    size_t gcStep(size_t budget) {
+        unique_lock<mutex> hold = guard();
+        PYROPE_ALLOCATOR_STAT(auto started = chrono::steady_clock::now());
+        size_t freed = 0;
+        for (; budget > 0 && !released.empty(); budget--)
+            freed += collect(popReleased());
+        for (; budget > 0 && !young.empty(); budget--) {
+            freed += collect(young.back());
+            young.pop_back();
+        }
+        PYROPE_ALLOCATOR_STAT(counters.gc_steps++, counters.collected(started));
+        return freed;
+    }
+    // Runs gcStep slices until the queues are empty or time is up
+    size_t gcFor(chrono::nanoseconds time) {
+        auto deadline = chrono::steady_clock::now() + time;
+        size_t freed = 0;
+        do {
+            freed += gcStep(GC_SLICE);
+        } while (gcPending() > 0 && chrono::steady_clock::now() < deadline);
+        return freed;
+    }
+    // Entries queued for the incremental collector
+    size_t gcPending() const {
+        unique_lock<mutex> hold = guard();
+        return released.size() + young.size();
+    }
+
+#ifdef PYROPE_ALLOCATOR_STATS
+    AllocatorStats stats() const {
+        AllocatorStats snapshot;
+        {
+            unique_lock<mutex> hold = guard();
+            snapshot = counters;
+            size_t count = slot_count.load(memory_order_relaxed);
+            snapshot.slots = count;
+            snapshot.free_slots = free_count;
+            for (size_t i = 0; i < count; i++) {
+                const Slot& slot = this->slot(i);
+                if (slot.is_free.load(memory_order_relaxed))
+                    continue;
+                snapshot.live_entries++;
+                snapshot.inline_entries += slot.memory.isInline();
+                snapshot.referenced_entries += slot.memory.ref_count.load(memory_order_relaxed) != 0;
+                snapshot.live_bytes += slot.memory.size;
+            }
+        }
+        SlabStats& heap = slabStats();
+        for (size_t i = 0; i <= SlabStats::LARGE; i++) {
+            snapshot.class_allocations[i] = heap.allocations[i].load(memory_order_relaxed);
+            snapshot.class_frees[i] = heap.frees[i].load(memory_order_relaxed);
+        }
+        snapshot.heap_live_bytes = heap.live_bytes.load(memory_order_relaxed);
+        snapshot.heap_reserved_bytes = heap.slab_bytes.load(memory_order_relaxed) + heap.large_bytes.load(memory_order_relaxed);
+        snapshot.grows = heap.grows.load(memory_order_relaxed);
+        snapshot.shrinks = heap.shrinks.load(memory_order_relaxed);
+        snapshot.resized_in_place = heap.resized_in_place.load(memory_order_relaxed);
+        snapshot.shared_copies = heap.shared_copies.load(memory_order_relaxed);
+        snapshot.unshared = heap.unshared.load(memory_order_relaxed);
+        return snapshot;
+    }
+    // Lists the entries still referenced, with their allocation sites in
+    // debug builds; returns how many there are. Prints nothing if none are.
+    size_t reportLeaks(ostream& os) const {
+        unique_lock<mutex> hold = guard();
+        size_t count = slot_count.load(memory_order_relaxed), leaks = 0;
+        for (size_t i = 0; i < count; i++) {
+            const Slot& slot = this->slot(i);
+            size_t references = slot.memory.ref_count.load(memory_order_relaxed);
+            if (slot.is_free.load(memory_order_relaxed) || references == 0 || references == RawMemory::DEAD)
+                continue;
+            if (leaks++ == 0)
+                os << "Allocator: entries still referenced:\n";
+            os << "    #" << i << ": " << slot.memory.size << " bytes, " << references << " references";
+            PYROPE_ALLOCATOR_DEBUG_ONLY(if (sites[i].file != nullptr)
+                os << ", allocated at " << sites[i].file << ':' << sites[i].line);
+            os << '\n';
+        }
+        return leaks;
+    }
+#endif
+
+private:
+    mutable mutex pool_lock;
+#ifdef PYROPE_ALLOCATOR_STATS
+    AllocatorStats counters;        // updated under the pool lock
+#endif
+#ifdef PYROPE_ALLOCATOR_DEBUG
+    vector<AllocationSite> sites;   // by slot index
+#endif
+
+    unique_lock<mutex> guard() const {
+        return concurrent ? unique_lock<mutex>(pool_lock) : unique_lock<mutex>();
+    }
+    uint32_t newSlot() {
+        size_t index = slot_count.load(memory_order_relaxed);
+        if (index >= NO_SLOT)
+            throw length_error("Allocator: too many entries");
+        size_t position = index + FIRST_CHUNK;
+        unsigned level = highestBit(position) - 10;
+        if (chunks[level].load(memory_order_relaxed) == nullptr)
+            chunks[level].store(new Slot[FIRST_CHUNK << level], memory_order_release);
+        PYROPE_ALLOCATOR_DEBUG_ONLY(sites.emplace_back());
+        slot_count.store(index + 1, memory_order_release);
+        return (uint32_t)index;
+    }
+    MemoryHandle track(MemoryHandle handle) {
+        if (generational)
+            young.push_back(handle);
+        return handle;
+    }
+    // Takes the last handle off released. A stale one leaves the bit to the
+    // current entry of its slot, which may be queued too.
+    MemoryHandle popReleased() {
+        MemoryHandle handle = released.back();
+        released.pop_back();
+        Slot& slot = this->slot(handle.index);
+        if (slot.generation.load(memory_order_relaxed) == handle.generation)
+            slot.queued = false;
+        return handle;
+    }
+    // Frees the entry of handle if it is still current and unreferenced
+    bool collect(MemoryHandle handle) {
+        if (!live(handle))
+            return false;
+        return claim(slot(handle.index), handle.index);
+    }
+    bool claim(Slot& slot, uint32_t index) {
+        size_t unreferenced = 0;
+        if (slot.memory.ref_count.load(memory_order_relaxed) != 0 || (concurrent
+            && !slot.memory.ref_count.compare_exchange_strong(unreferenced, RawMemory::DEAD, memory_order_acq_rel)))
+            return false;
+        PYROPE_ALLOCATOR_STAT(counters.reclaimed_entries++, counters.reclaimed_bytes += slot.memory.size);
+        slot.memory.free_();
+        pushFree(index);
+        return true;
+    }
+    void pushFree(uint32_t index) {
+        Slot& slot = this->slot(index);
+        slot.memory.ref_count.store(RawMemory::DEAD, memory_order_relaxed);
+        // only changed under the pool lock
+        slot.generation.store(slot.generation.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        slot.is_free.store(true, memory_order_release);
+        slot.queued = false;
+        slot.next_free = free_top;
+        free_top = index;
+        free_count++;
+    }
+};
+
+// Bump allocator for data that dies together, such as the tokens, nodes and
+// strings of one compilation. Objects are never freed one by one: rewind()
+// drops everything allocated after a checkpoint and reset() everything,
+// both in O(1). Chunks are kept for reuse, so a workload repeated after
+// reset() allocates nothing. Not thread-safe.
+class Arena {
+public:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    struct Checkpoint {
+        size_t chunk;
+        size_t used;
+    };
+
+    Arena() {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    Arena(Arena&&) = default;
+    Arena& operator=(Arena&&) = default;
+
+    // alignment must be a power of two
+    void* allocate(size_t bytes, size_t alignment = alignof(max_align_t)) {
+        if (current < chunks.size()) {
+            void* block = fit(chunks[current], used, bytes, alignment);
+            if (block != nullptr)
+                return block;
+        }
+        return allocateSlow(bytes, alignment);
+    }
+
+    // A T built in the arena. Its destructor is never run.
+    template<typename T, typename... Args>
+    T* make(Args&&... args) {
+        static_assert(is_trivially_destructible<T>::value, "Arena never runs destructors");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+    // count value-initialized Ts
+    template<typename T>
+    T* makeArray(size_t count) {
+        static_assert(is_trivially_destructible<T>::value, "Arena never runs destructors");
+        if (count > SIZE_MAX / sizeof(T))
+            throw std::bad_alloc();
+        T* items = (T*)allocate(sizeof(T) * count, alignof(T));
+        for (size_t i = 0; i < count; i++)
+            new (items + i) T();
+        return items;
+    }
+    template<typename T>
+    T* copyArray(const T* items, size_t count) {
+        static_assert(is_trivially_copyable<T>::value, "copyArray copies bytes");
+        if (count > SIZE_MAX / sizeof(T))
+            throw std::bad_alloc();
+        T* copy = (T*)allocate(sizeof(T) * count, alignof(T));
+        if (count > 0)
+            memcpy(copy, items, sizeof(T) * count);
+        return copy;
+    }
+    string_view copy(string_view text) {
+        return string_view(copyArray(text.data(), text.size()), text.size());
+    }
+
+    Checkpoint checkpoint() const {
+        return { current, used };
+    }
+    // Drops everything allocated since the checkpoint was taken
+    void rewind(Checkpoint checkpoint) {
+        current = checkpoint.chunk;
+        used = checkpoint.used;
+    }
+    void reset() {
+        current = 0;
+        used = 0;
+    }
+
+    // Bytes handed out, counting the alignment padding and chunk tails
+    // skipped over
+    size_t bytesUsed() const {
+        size_t bytes = current < chunks.size() ? used : 0;
+        for (size_t i = 0; i < current && i < chunks.size(); i++)
+            bytes += chunks[i].size;
+        return bytes;
+    }
+    size_t bytesReserved() const {
+        size_t bytes = 0;
+        for (const Chunk& chunk : chunks)
+            bytes += chunk.size;
+        return bytes;
+    }
+
+private:
+    struct Chunk {
+        unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    vector<Chunk> chunks;
+    size_t current = 0;     // chunk being filled
+    size_t used = 0;        // bytes of it handed out
+
+    void* fit(const Chunk& chunk, size_t& offset, size_t bytes, size_t alignment) {
+        uintptr_t base = (uintptr_t)chunk.data.get();
+        uintptr_t start = (base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1);
+        if (start - base > chunk.size || bytes > chunk.size - (start - base))
+            return nullptr;
+        offset = start - base + bytes;
+        return (void*)start;
+    }
+    // Moves on to the next kept chunk that fits, or puts a new one after
+    // the current chunk, so that the chunks are met in the same order again
+    // after a reset
+    void* allocateSlow(size_t bytes, size_t alignment) {
+        size_t next = current < chunks.size() ? current + 1 : 0;
+        for (; next < chunks.size(); next++) {
+            size_t offset = 0;
+            void* block = fit(chunks[next], offset, bytes, alignment);
+            if (block != nullptr) {
+                current = next;
+                used = offset;
+                return block;
             }
         }
+        next = current < chunks.size() ? current + 1 : chunks.size();
+        size_t size = max(CHUNK_SIZE, bytes + alignment);
+        chunks.insert(chunks.begin() + next, Chunk{ unique_ptr<char[]>(new char[size]), size });
+        current = next;
+        used = 0;
+        return fit(chunks[current], used, bytes, alignment);
     }
 };
 
+// Standard allocator over an Arena, for containers whose memory should go
+// with the arena. deallocate does nothing; the memory returns on reset.
+template<typename T>
+struct ArenaAllocator {
+    typedef T value_type;
+    typedef true_type propagate_on_container_move_assignment;
+    typedef true_type propagate_on_container_swap;
+
+    Arena* arena;
+
+    ArenaAllocator(Arena& arena) noexcept : arena(&arena) {}
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena(other.arena) {}
+
+    T* allocate(size_t count) {
+        if (count > SIZE_MAX / sizeof(T))
+            throw std::bad_alloc();
+        return (T*)arena->allocate(sizeof(T) * count, alignof(T));
+    }
+    void deallocate(T*, size_t) noexcept {}
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U>& other) const {
+        return arena == other.arena;
+    }
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const {
+        return arena != other.arena;
+    }
+};
@@ -0,0 +1,383 @@
+﻿/*
+* Copyright 2025 github.com/PD758
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*      http://www.apache.org/licenses/LICENSE-2.0
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#pragma once
+
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "../allocator.hpp"
+
+// Sizes of small script values, with an occasional large buffer
+static const vector<size_t>& allocatorBenchSizes() {
+	static const vector<size_t> sizes = [] {
+		mt19937 rng(2025);
+		vector<size_t> out(1 << 16);
+		for (size_t& size : out)
+			size = rng() % 64 == 0 ? 4096 + rng() % 8192 : 1 + rng() % 96;
+		return out;
+	}();
+	return sizes;
+}
+
+static constexpr size_t ALLOCATOR_BENCH_LIVE = 4096;
+
+// Replaces one of ALLOCATOR_BENCH_LIVE live values per step
+BENCHMARK("allocator/raw_memory_churn") {
+	const vector<size_t>& sizes = allocatorBenchSizes();
+	vector<RawMemory> live(ALLOCATOR_BENCH_LIVE);
+	size_t step = 0;
+	for (size_t it = 0; it < state.iterations; it++)
+		for (size_t size : sizes) {
+			RawMemory& slot = live[step++ % ALLOCATOR_BENCH_LIVE];
+			slot.free_();
+			slot.realloc_(size);
+		}
+	bench::keep(live[0].cdata());
+	state.items = sizes.size();
+	state.unit = "allocs";
+}
+
+// Scalar values, INT8 to INT64, double and 16-byte pairs: every live value
+// is replaced, then all of them are read back in scattered order
+BENCHMARK("allocator/scalar_values") {
+	static const size_t scalar_sizes[] = { 1, 2, 4, 8, 8, 8, 16 };
+	vector<RawMemory> live(ALLOCATOR_BENCH_LIVE);
+	size_t sum = 0;
+	for (size_t it = 0; it < state.iterations; it++) {
+		for (size_t i = 0; i < ALLOCATOR_BENCH_LIVE; i++) {
+			RawMemory& value = live[i];
+			value.free_();
+			value.realloc_(scalar_sizes[(i + it) % 7]);
+			*(uint8_t*)value.mdata() = (uint8_t)i;
+		}
+		for (size_t i = 0; i < ALLOCATOR_BENCH_LIVE; i++)
+			sum += *(const uint8_t*)live[i * 97 % ALLOCATOR_BENCH_LIVE].cdata();
+	}
+	bench::keep(sum);
+	state.items = ALLOCATOR_BENCH_LIVE;
+	state.unit = "values";
+}
+
+// The same churn on malloc and free, as RawMemory did before SlabHeap
+BENCHMARK("allocator/malloc_churn") {
+	const vector<size_t>& sizes = allocatorBenchSizes();
+	vector<void*> live(ALLOCATOR_BENCH_LIVE, nullptr);
+	size_t step = 0;
+	for (size_t it = 0; it < state.iterations; it++)
+		for (size_t size : sizes) {
+			void*& slot = live[step++ % ALLOCATOR_BENCH_LIVE];
+			free(slot);
+			slot = malloc(size);
+		}
+	bench::keep(live[0]);
+	for (void* block : live)
+		free(block);
+	state.items = sizes.size();
+	state.unit = "allocs";
+}
+
+// Values growing one byte at a time, as a string being appended to
+BENCHMARK("allocator/realloc_growth") {
+	RawMemory value;
+	for (size_t it = 0; it < state.iterations; it++) {
+		for (size_t size = 1; size <= 1024; size++)
+			value.realloc_(size);
+		value.free_();
+	}
+	bench::keep(value.cdata());
+	state.items = 1024;
+	state.unit = "reallocs";
+}
+
+// A 1 MB STRING value passed by value through a call chain: copies share
+// the buffer, so a pass costs the same for any size
+static size_t allocatorBenchByValue(RawMemory value, size_t depth) {
+	return depth == 0 ? value.size : allocatorBenchByValue(value, depth - 1);
+}
+
+BENCHMARK("allocator/pass_by_value_1mb") {
+	RawMemory value(1 << 20);
+	value.fill('x');
+	size_t sum = 0;
+	for (size_t it = 0; it < state.iterations; it++)
+		sum += allocatorBenchByValue(value, 7);
+	bench::keep(sum);
+	state.items = 8;
+	state.unit = "copies";
+}
+
+// The same chain where each callee writes to its copy, as a deep copy
+// costs
+static size_t allocatorBenchWritten(RawMemory value, size_t depth) {
+	((uint8_t*)value.mdata())[depth] = (uint8_t)depth;
+	return depth == 0 ? value.size : allocatorBenchWritten(value, depth - 1);
+}
+
+BENCHMARK("allocator/pass_by_value_1mb_written") {
+	RawMemory value(1 << 20);
+	value.fill('x');
+	size_t sum = 0;
+	for (size_t it = 0; it < state.iterations; it++)
+		sum += allocatorBenchWritten(value, 7);
+	bench::keep(sum);
+	state.items = 8;
+	state.unit = "copies";
+}
+
+// Copies of the churn's values: inline ones are copied, the others share
+// their block
+BENCHMARK("allocator/raw_memory_copy") {
+	const vector<size_t>& sizes = allocatorBenchSizes();
+	vector<RawMemory> values(ALLOCATOR_BENCH_LIVE), copies(ALLOCATOR_BENCH_LIVE);
+	for (size_t i = 0; i < ALLOCATOR_BENCH_LIVE; i++) {
+		values[i].realloc_(sizes[i]);
+		values[i].fill((uint8_t)i);
+	}
+	for (size_t it = 0; it < state.iterations; it++)
+		for (size_t i = 0; i < ALLOCATOR_BENCH_LIVE; i++)
+			copies[i] = values[i];
+	bench::keep(copies[0].cdata());
+	state.items = ALLOCATOR_BENCH_LIVE;
+	state.unit = "copies";
+}
+
+// same_as on equal values in separate buffers, which compares the bytes
+BENCHMARK("allocator/raw_memory_same_as") {
+	const vector<size_t>& sizes = allocatorBenchSizes();
+	vector<RawMemory> values(ALLOCATOR_BENCH_LIVE), others(ALLOCATOR_BENCH_LIVE);
+	size_t bytes = 0;
+	for (size_t i = 0; i < ALLOCATOR_BENCH_LIVE; i++) {
+		values[i].realloc_(sizes[i]);
+		values[i].fill((uint8_t)i);
+		others[i].realloc_(sizes[i]);
+		others[i].fill((uint8_t)i);
+		bytes += sizes[i];
+	}
+	size_t equal = 0;
+	for (size_t it = 0; it < state.iterations; it++)
+		for (size_t i = 0; i < ALLOCATOR_BENCH_LIVE; i++)
+			equal += values[i].same_as(others[i]);
+	bench::keep(equal);
+	state.items = ALLOCATOR_BENCH_LIVE;
+	state.unit = "compares";
+	state.counters.push_back({ "B", (double)bytes });
+}
+
+// Allocator rounds: the previous round's values are released, a new batch
+// is allocated with half of it kept referenced, then gc()
+BENCHMARK("allocator/pool_alloc_gc") {
+	const vector<size_t>& sizes = allocatorBenchSizes();
+	Allocator allocator;
+	vector<MemoryHandle> held;
+	for (size_t it = 0; it < state.iterations; it++) {
+		for (MemoryHandle handle : held)
+			allocator.release(handle);
+		held.clear();
+		for (size_t i = 0; i < ALLOCATOR_BENCH_LIVE; i++) {
+			MemoryHandle handle = allocator.alloc(sizes[i], i % 2 == 0);
+			if (i % 2 == 0)
+				held.push_back(handle);
+		}
+		allocator.gc();
+	}
+	bench::keep(allocator.size());
+	state.items = ALLOCATOR_BENCH_LIVE;
+	state.unit = "allocs";
+}
+
+// A large heap of long-lived values, then frames that each allocate a batch,
+// keep a quarter of it for a while and collect. The samples are the times of
+// the collections.
+template<typename Collect>
+static void allocatorGcPauses(bench::State& state, Collect collect) {
+	using clock = chrono::steady_clock;
+	const vector<size_t>& sizes = allocatorBenchSizes();
+	Allocator allocator;
+	// the unretained part of a batch is only found through the young queue
+	allocator.generational = true;
+	for (size_t i = 0; i < (size_t(1) << 18); i++)
+		allocator.retain(allocator.alloc(sizes[i % 1024] % 64));
+	allocator.gc();
+	vector<MemoryHandle> kept(4096);
+	size_t step = 0;
+	for (size_t it = 0; it < state.iterations; it++) {
+		for (size_t i = 0; i < 256; i++) {
+			MemoryHandle handle = allocator.alloc(sizes[(step + i) % sizes.size()] % 64);
+			if (i % 4 == 0) {
+				MemoryHandle& slot = kept[step++ % kept.size()];
+				if (slot.index != MemoryHandle::NO_INDEX)
+					allocator.release(slot);
+				allocator.retain(handle);
+				slot = handle;
+			}
+		}
+		auto start = clock::now();
+		collect(allocator);
+		state.samples.push_back((double)chrono::duration_cast<chrono::nanoseconds>(clock::now() - start).count());
+	}
+	bench::keep(allocator.size());
+	state.items = 256;
+	state.unit = "allocs";
+}
+
+BENCHMARK("allocator/gc_pause_full") {
+	allocatorGcPauses(state, [](Allocator& allocator) { allocator.gc(); });
+}
+
+BENCHMARK("allocator/gc_pause_incremental") {
+	allocatorGcPauses(state, [](Allocator& allocator) { allocator.gcStep(512); });
+}
+
+BENCHMARK("allocator/gc_pause_timed") {
+	allocatorGcPauses(state, [](Allocator& allocator) { allocator.gcFor(chrono::microseconds(20)); });
+}
+
+// Churn of thread-local values on every thread, served by the slab caches
+static void slabChurnThreads(bench::State& state, size_t threads) {
+	const vector<size_t>& sizes = allocatorBenchSizes();
+	for (size_t it = 0; it < state.iterations; it++) {
+		vector<thread> workers;
+		for (size_t t = 0; t < threads; t++)
+			workers.emplace_back([&, t] {
+				vector<RawMemory> live(ALLOCATOR_BENCH_LIVE);
+				size_t step = t;
+				for (size_t size : sizes) {
+					RawMemory& slot = live[step++ % ALLOCATOR_BENCH_LIVE];
+					slot.free_();
+					slot.realloc_(size);
+				}
+				bench::keep(live[0].cdata());
+			});
+		for (thread& worker : workers)
+			worker.join();
+	}
+	state.items = sizes.size() * threads;
+	state.unit = "allocs";
+}
+
+// Every thread allocating, releasing and collecting in one shared pool
+static void sharedPoolThreads(bench::State& state, size_t threads) {
+	const vector<size_t>& sizes = allocatorBenchSizes();
+	Allocator allocator(true);
+	for (size_t it = 0; it < state.iterations; it++) {
+		vector<thread> workers;
+		for (size_t t = 0; t < threads; t++)
+			workers.emplace_back([&] {
+				vector<MemoryHandle> kept(256);
+				size_t step = 0;
+				for (size_t size : sizes) {
+					MemoryHandle& slot = kept[step++ % kept.size()];
+					if (slot.index != MemoryHandle::NO_INDEX)
+						allocator.release(slot);
+					slot = allocator.alloc(size, 1);
+					if (step % 256 == 0)
+						allocator.gcStep(512);
+				}
+				for (MemoryHandle handle : kept)
+					allocator.release(handle);
+			});
+		for (thread& worker : workers)
+			worker.join();
+		allocator.gc();
+	}
+	bench::keep(allocator.size());
+	state.items = sizes.size() * threads;
+	state.unit = "allocs";
+}
+
+BENCHMARK("allocator/slab_threads/1") {
+	slabChurnThreads(state, 1);
+}
+BENCHMARK("allocator/slab_threads/2") {
+	slabChurnThreads(state, 2);
+}
+BENCHMARK("allocator/slab_threads/4") {
+	slabChurnThreads(state, 4);
+}
+BENCHMARK("allocator/slab_threads/8") {
+	slabChurnThreads(state, 8);
+}
+
+BENCHMARK("allocator/shared_pool_threads/1") {
+	sharedPoolThreads(state, 1);
+}
+BENCHMARK("allocator/shared_pool_threads/2") {
+	sharedPoolThreads(state, 2);
+}
+BENCHMARK("allocator/shared_pool_threads/4") {
+	sharedPoolThreads(state, 4);
+}
+BENCHMARK("allocator/shared_pool_threads/8") {
+	sharedPoolThreads(state, 8);
+}
+
+// A node of a flat syntax tree, as a compiler phase would build them
+struct ArenaBenchNode {
+	uint32_t kind;
+	uint32_t first_child;
+	uint32_t child_count;
+	double value;
+};
+
+// Builds a compilation's worth of nodes and strings, then drops them at once
+BENCHMARK("arena/make_nodes") {
+	Arena arena;
+	for (size_t it = 0; it < state.iterations; it++) {
+		arena.reset();
+		for (uint32_t i = 0; i < 65536; i++) {
+			ArenaBenchNode* node = arena.make<ArenaBenchNode>(ArenaBenchNode{ i % 7, i, 2, 0.5 });
+			bench::keep(node);
+			if (i % 8 == 0)
+				bench::keep(arena.copy("identifier_name").data());
+		}
+	}
+	state.items = 65536;
+	state.unit = "nodes";
+}
+
+// The same nodes and strings, each with new and delete, as a baseline
+BENCHMARK("arena/new_delete_nodes") {
+	vector<ArenaBenchNode*> nodes(65536);
+	vector<string*> names(65536 / 8);
+	for (size_t it = 0; it < state.iterations; it++) {
+		for (uint32_t i = 0; i < 65536; i++) {
+			nodes[i] = new ArenaBenchNode{ i % 7, i, 2, 0.5 };
+			if (i % 8 == 0)
+				names[i / 8] = new string("identifier_name");
+		}
+		for (ArenaBenchNode* node : nodes)
+			delete node;
+		for (string* name : names)
+			delete name;
+	}
+	state.items = 65536;
+	state.unit = "nodes";
+}
+
+// Scratch arrays taken and given back around each statement
+BENCHMARK("arena/checkpoint_rewind") {
+	Arena arena;
+	for (size_t it = 0; it < state.iterations; it++)
+		for (size_t i = 0; i < 4096; i++) {
+			Arena::Checkpoint mark = arena.checkpoint();
+			uint32_t* scratch = arena.makeArray<uint32_t>(16 + i % 48);
+			bench::keep(scratch);
+			arena.rewind(mark);
+		}
+	state.items = 4096;
+	state.unit = "rewinds";
+}
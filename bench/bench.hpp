@@ -0,0 +1,164 @@
+﻿/*
+* Copyright 2025 github.com/PD758
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*      http://www.apache.org/licenses/LICENSE-2.0
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Minimal benchmark harness: a case runs its body for a batch of iterations
+// and reports how many items (bytes, tokens, lookups...) one iteration handled.
+namespace bench {
+	struct State {
+		size_t iterations = 0;
+		size_t items = 0;	// processed per iteration
+		const char* unit = "items";
+		vector<double> samples;	// optional per-operation times in ns, reported as percentiles
+		vector<pair<const char*, double>> counters;	// more per-iteration counts, reported per second
+	};
+
+	struct Case {
+		string name;
+		function<void(State&)> body;
+	};
+
+	inline vector<Case>& registry() {
+		static vector<Case> cases;
+		return cases;
+	}
+
+	struct Register {
+		Register(const char* name, function<void(State&)> body) {
+			registry().push_back({ name, move(body) });
+		}
+	};
+
+	// Keeps the compiler from discarding a computed value
+	template<typename T>
+	inline void keep(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+		asm volatile("" : : "r,m"(value) : "memory");
+#else
+		static volatile const T* sink;
+		sink = &value;
+#endif
+	}
+
+	struct Result {
+		string name;
+		double ns_per_iteration;
+		double items_per_second;
+		const char* unit;
+		vector<double> percentiles;	// p50, p99 and max of the samples, if any
+		vector<pair<string, double>> rates;	// counters per second
+	};
+
+	inline vector<double> percentiles(vector<double> samples) {
+		if (samples.empty())
+			return {};
+		sort(samples.begin(), samples.end());
+		auto at = [&](double p) { return samples[(size_t)(p * (double)(samples.size() - 1))]; };
+		return { at(0.5), at(0.99), samples.back() };
+	}
+
+	// Doubles the iteration count until one batch takes at least min_seconds
+	inline Result run(const Case& c, double min_seconds) {
+		using clock = chrono::steady_clock;
+		State state;
+		state.iterations = 1;
+		while (true) {
+			state.samples.clear();
+			state.counters.clear();
+			auto start = clock::now();
+			c.body(state);
+			double elapsed = chrono::duration<double>(clock::now() - start).count();
+			if (elapsed >= min_seconds || state.iterations >= (size_t(1) << 40)) {
+				double per_iteration = elapsed / (double)state.iterations;
+				vector<pair<string, double>> rates;
+				for (const auto& counter : state.counters)
+					rates.push_back({ counter.first, per_iteration > 0 ? counter.second / per_iteration : 0.0 });
+				return { c.name, per_iteration * 1e9,
+					per_iteration > 0 ? (double)state.items / per_iteration : 0.0, state.unit,
+					percentiles(move(state.samples)), move(rates) };
+			}
+			state.iterations *= 2;
+		}
+	}
+
+	inline void print(const Result& r) {
+		printf("%-40s %14.1f ns/iter %14.3f M%s/s",
+			r.name.c_str(), r.ns_per_iteration, r.items_per_second / 1e6, r.unit);
+		for (const auto& rate : r.rates)
+			printf(" %10.3f M%s/s", rate.second / 1e6, rate.first.c_str());
+		if (!r.percentiles.empty())
+			printf("   p50 %.0f  p99 %.0f  max %.0f ns", r.percentiles[0], r.percentiles[1], r.percentiles[2]);
+		printf("\n");
+	}
+
+	inline void jsonString(FILE* out, const string& text) {
+		fputc('"', out);
+		for (char c : text) {
+			if (c == '"' || c == '\\')
+				fputc('\\', out);
+			if ((unsigned char)c < 0x20)
+				fprintf(out, "\\u%04x", c);
+			else
+				fputc(c, out);
+		}
+		fputc('"', out);
+	}
+
+	// Machine-readable results, one object per case:
+	// {"benchmarks": [{"name", "ns_per_iteration", "items_per_second", "unit",
+	//   "rates": {unit: per second}, "percentiles_ns": {"p50", "p99", "max"}}]}
+	inline void writeJson(FILE* out, const vector<Result>& results) {
+		fprintf(out, "{\n  \"benchmarks\": [");
+		for (size_t i = 0; i < results.size(); i++) {
+			const Result& r = results[i];
+			fprintf(out, "%s\n    {\"name\": ", i > 0 ? "," : "");
+			jsonString(out, r.name);
+			fprintf(out, ", \"ns_per_iteration\": %.1f, \"items_per_second\": %.1f, \"unit\": ",
+				r.ns_per_iteration, r.items_per_second);
+			jsonString(out, r.unit);
+			if (!r.rates.empty()) {
+				fprintf(out, ", \"rates\": {");
+				for (size_t j = 0; j < r.rates.size(); j++) {
+					fprintf(out, "%s", j > 0 ? ", " : "");
+					jsonString(out, r.rates[j].first);
+					fprintf(out, ": %.1f", r.rates[j].second);
+				}
+				fprintf(out, "}");
+			}
+			if (!r.percentiles.empty())
+				fprintf(out, ", \"percentiles_ns\": {\"p50\": %.0f, \"p99\": %.0f, \"max\": %.0f}",
+					r.percentiles[0], r.percentiles[1], r.percentiles[2]);
+			fprintf(out, "}");
+		}
+		fprintf(out, "\n  ]\n}\n");
+	}
+}
+
+#define BENCH_CONCAT_(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT_(a, b)
+// __COUNTER__ rather than __LINE__: every bench header shares one translation unit
+#define BENCHMARK_(name, id) \
+	static void BENCH_CONCAT(bench_fn_, id)(bench::State& state); \
+	static bench::Register BENCH_CONCAT(bench_reg_, id)(name, BENCH_CONCAT(bench_fn_, id)); \
+	static void BENCH_CONCAT(bench_fn_, id)(bench::State& state)
+#define BENCHMARK(name) BENCHMARK_(name, __COUNTER__)
@@ -0,0 +1,155 @@
+﻿/*
+* Copyright 2025 github.com/PD758
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*      http://www.apache.org/licenses/LICENSE-2.0
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "../tokenizer.hpp"
+
+// What a synthetic source is made of. Every token of a statement is an
+// identifier, a literal or an operator, picked by weight; comment_lines
+// is the percentage of lines carrying a comment and max_depth bounds the
+// nesting of blocks. A mix and its seed give the same bytes on every
+// platform: mt19937 is fully specified and only its raw output is used.
+struct CorpusMix {
+	unsigned identifiers = 6;
+	unsigned literals = 2;
+	unsigned operators = 3;
+	unsigned comment_lines = 10;
+	size_t max_depth = 6;
+	uint32_t seed = 2025;
+	size_t size = size_t(4) << 20;	// bytes, the last line may overshoot
+};
+
+inline string generateCorpus(const CorpusMix& mix) {
+	mt19937 rng(mix.seed);
+	vector<string> names;
+	for (size_t i = 0; i < 64; i++) {
+		string name(1, (char)('a' + rng() % 26));
+		for (size_t length = 1 + rng() % 16; name.size() < length;)
+			name += "abcdefghijklmnopqrstuvwxyz_0123456789"[rng() % 37];
+		names.push_back(name);
+	}
+	const char* strings[] = { "\"text\"", "\"a longer string literal\"", "\"tab\\tand newline\\n\"", "\"\"" };
+	const char* chars[] = { "'a'", "'\\n'", "'\\''", "'z'" };
+	unsigned total = mix.identifiers + mix.literals + mix.operators;
+	if (total == 0)
+		total = 1;
+
+	string out;
+	size_t depth = 0;
+	while (out.size() < mix.size) {
+		out.append(depth * 4, ' ');
+		if (rng() % 100 < mix.comment_lines && rng() % 2 == 0) {
+			out += "# a comment line\n";
+			continue;
+		}
+		bool opens = depth < mix.max_depth && rng() % 6 == 0;
+		if (opens)
+			out += rng() % 2 == 0 ? "IF " : "WHILE ";
+		for (size_t count = 3 + rng() % 8; count > 0; count--) {
+			unsigned pick = rng() % total;
+			if (pick < mix.identifiers) {
+				if (rng() % 4 == 0)
+					out += _pyrope::KEYWORDS[rng() % _pyrope::KEYWORD_COUNT].text;
+				else
+					out += names[rng() % names.size()];
+			}
+			else if (pick < mix.identifiers + mix.literals) {
+				switch (rng() % 6) {
+				case 0: out += to_string(rng()); break;
+				case 1: out += to_string(rng() % 1000) + "." + to_string(rng() % 1000); break;
+				case 2: out += "0x" + to_string(rng() % 90000 + 10000); break;
+				case 3: out += to_string(rng() % 100); break;
+				case 4: out += strings[rng() % 4]; break;
+				default: out += chars[rng() % 4]; break;
+				}
+			}
+			else {
+				// ':' would open a block the indentation does not follow
+				string_view op = _pyrope::OPERATORS[rng() % _pyrope::OPERATOR_COUNT].text;
+				out += op == ":" ? "," : op;
+			}
+			out += ' ';
+		}
+		out.pop_back();
+		if (opens)
+			out += ':';
+		else if (rng() % 100 < mix.comment_lines)
+			out += "  # trailing comment";
+		out += '\n';
+		if (opens)
+			depth++;
+		else if (depth > 0 && rng() % 5 == 0)
+			depth -= 1 + rng() % depth;
+	}
+	return out;
+}
+
+// tokenize throughput on a corpus, in bytes and tokens
+static void tokenizeCorpus(bench::State& state, const CorpusMix& mix) {
+	static vector<pair<const CorpusMix*, string>> cache;
+	const string* source = nullptr;
+	for (const auto& entry : cache)
+		if (entry.first == &mix)
+			source = &entry.second;
+	if (source == nullptr) {
+		cache.emplace_back(&mix, generateCorpus(mix));
+		source = &cache.back().second;
+	}
+	TokenBuffer tokens;
+	for (size_t it = 0; it < state.iterations; it++)
+		if (tokenize(*source, tokens).is_traceback) {
+			fprintf(stderr, "the generated corpus does not tokenize\n");
+			exit(1);
+		}
+	state.items = source->size();
+	state.unit = "B";
+	state.counters.push_back({ "tokens", (double)tokens.size() });
+}
+
+static const CorpusMix CORPUS_MIXED;
+static const CorpusMix CORPUS_IDENTIFIERS = { 12, 1, 1, 2, 4 };
+static const CorpusMix CORPUS_LITERALS = { 2, 10, 2, 2, 4 };
+static const CorpusMix CORPUS_OPERATORS = { 2, 1, 12, 2, 4 };
+static const CorpusMix CORPUS_COMMENTS = { 6, 2, 3, 60, 4 };
+static const CorpusMix CORPUS_DEEP = { 6, 2, 3, 10, 40 };
+
+BENCHMARK("corpus/mixed") {
+	tokenizeCorpus(state, CORPUS_MIXED);
+}
+
+BENCHMARK("corpus/identifiers") {
+	tokenizeCorpus(state, CORPUS_IDENTIFIERS);
+}
+
+BENCHMARK("corpus/literals") {
+	tokenizeCorpus(state, CORPUS_LITERALS);
+}
+
+BENCHMARK("corpus/operators") {
+	tokenizeCorpus(state, CORPUS_OPERATORS);
+}
+
+BENCHMARK("corpus/comments") {
+	tokenizeCorpus(state, CORPUS_COMMENTS);
+}
+
+BENCHMARK("corpus/deep_blocks") {
+	tokenizeCorpus(state, CORPUS_DEEP);
+}
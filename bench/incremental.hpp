@@ -0,0 +1,87 @@
+﻿/*
+* Copyright 2025 github.com/PD758
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*      http://www.apache.org/licenses/LICENSE-2.0
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#pragma once
+
+#include <random>
+#include <string>
+
+#include "bench.hpp"
+#include "tokenize.hpp"
+#include "../incremental_tokenizer.hpp"
+
+// 100k lines of nested blocks, the size of a large file open in an editor
+static const string& editBenchSource() {
+	static const string source = [] {
+		const string& text = tokenizeBenchSource();
+		size_t end = 0;
+		for (size_t lines = 0; lines < 100000 && end < text.size(); lines++)
+			end = text.find('\n', end) + 1;
+		return text.substr(0, end);
+	}();
+	return source;
+}
+
+// One keystroke: a character typed into a name and deleted again, on a
+// random line of a 100k-line file
+BENCHMARK("retokenize/keystroke") {
+	string source = editBenchSource();
+	SymbolTable symbols;
+	TokenBuffer tokens;
+	tokenize(source, tokens, symbols);
+	mt19937 rng(11);
+	for (size_t it = 0; it < state.iterations; it++) {
+		size_t line = rng() % (tokens.line_starts.size() - 1);
+		size_t offset = source.find_first_not_of(' ', tokens.line_starts[line]) + 1;
+		TextEdit typed{ offset, 0, "z" };
+		applyEdit(source, typed);
+		retokenize(tokens, source, typed, &symbols);
+		TextEdit erased{ offset, 1, "" };
+		applyEdit(source, erased);
+		retokenize(tokens, source, erased, &symbols);
+	}
+	bench::keep(tokens.size());
+	state.items = 2;
+	state.unit = "edits";
+}
+
+// A new line typed at the indentation of the line below it
+BENCHMARK("retokenize/insert_line") {
+	string source = editBenchSource();
+	TokenBuffer tokens;
+	tokenize(source, tokens);
+	mt19937 rng(12);
+	for (size_t it = 0; it < state.iterations; it++) {
+		size_t start = tokens.line_starts[rng() % (tokens.line_starts.size() - 1)];
+		string line = source.substr(start, source.find_first_not_of(' ', start) - start) + "value = x + 1\n";
+		TextEdit opened{ start, 0, line };
+		applyEdit(source, opened);
+		retokenize(tokens, source, opened);
+		TextEdit closed{ start, line.size(), "" };
+		applyEdit(source, closed);
+		retokenize(tokens, source, closed);
+	}
+	bench::keep(tokens.size());
+	state.items = 2;
+	state.unit = "edits";
+}
+
+BENCHMARK("retokenize/full_relex") {
+	const string& source = editBenchSource();
+	TokenBuffer tokens;
+	for (size_t it = 0; it < state.iterations; it++)
+		tokenize(source, tokens);
+	bench::keep(tokens.size());
+	state.items = 1;
+	state.unit = "edits";
+}
@@ -0,0 +1,94 @@
+﻿/*
+* Copyright 2025 github.com/PD758
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*      http://www.apache.org/licenses/LICENSE-2.0
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#pragma once
+
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bench.hpp"
+#include "../tokenizer.hpp"
+
+// handleKeyword as it was before the compile-time hash, kept as the baseline
+static TokenType handleKeywordMap(const string& lexeme) {
+	static const unordered_map<string, TokenType> keywords = [] {
+		unordered_map<string, TokenType> map;
+		for (const _pyrope::Keyword& keyword : _pyrope::KEYWORDS)
+			map.emplace(string(keyword.text), keyword.type);
+		return map;
+	}();
+	auto it = keywords.find(lexeme);
+	if (it != keywords.end())
+		return it->second;
+	return TokenType::Identifier;
+}
+
+// Identifier-heavy word list: one keyword for every three names, names
+// share prefixes and lengths with the keywords to defeat length filtering
+static const vector<string>& keywordBenchWords() {
+	static const vector<string> words = [] {
+		mt19937 rng(12345);
+		const char* stems[] = { "INT", "I", "value", "count", "FOR", "index", "Tr", "RETURN_", "x", "buffer" };
+		vector<string> out;
+		for (size_t i = 0; i < 4096; i++) {
+			if (i % 3 == 0) {
+				out.push_back(string(_pyrope::KEYWORDS[rng() % _pyrope::KEYWORD_COUNT].text));
+			}
+			else {
+				string word = stems[rng() % 10];
+				size_t extra = rng() % 6;
+				for (size_t j = 0; j < extra; j++)
+					word += (char)('a' + rng() % 26);
+				out.push_back(word);
+			}
+		}
+		return out;
+	}();
+	return words;
+}
+
+BENCHMARK("keywords/unordered_map") {
+	const vector<string>& words = keywordBenchWords();
+	size_t found = 0;
+	for (size_t it = 0; it < state.iterations; it++)
+		for (const string& word : words)
+			found += handleKeywordMap(word) != TokenType::Identifier;
+	bench::keep(found);
+	state.items = words.size();
+	state.unit = "lookups";
+}
+
+BENCHMARK("keywords/unordered_map+substr") {
+	// what tokenize used to pay: a fresh std::string per identifier
+	const vector<string>& words = keywordBenchWords();
+	size_t found = 0;
+	for (size_t it = 0; it < state.iterations; it++)
+		for (const string& word : words)
+			found += handleKeywordMap(word.substr(0)) != TokenType::Identifier;
+	bench::keep(found);
+	state.items = words.size();
+	state.unit = "lookups";
+}
+
+BENCHMARK("keywords/perfect_hash") {
+	const vector<string>& words = keywordBenchWords();
+	size_t found = 0;
+	for (size_t it = 0; it < state.iterations; it++)
+		for (const string& word : words)
+			found += _pyrope::keywordSymbol(word.data(), word.size()) != _pyrope::NO_SYMBOL;
+	bench::keep(found);
+	state.items = words.size();
+	state.unit = "lookups";
+}
@@ -0,0 +1,62 @@
+﻿/*
+* Copyright 2025 github.com/PD758
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*      http://www.apache.org/licenses/LICENSE-2.0
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+// Benchmark suite. Everything is header-only, so the suite is a single
+// translation unit, built by CMakeLists.txt or by hand:
+//     g++ -std=c++17 -O2 -pthread -o pyrope_bench bench/main.cpp
+// Usage: pyrope_bench [--json FILE] [filter] - runs the cases whose name
+// contains filter; with --json the results are also written to FILE, or to
+// stdout for "-", instead of the table.
+#include <cstring>
+
+#include "allocator.hpp"
+#include "bench.hpp"
+#include "corpus.hpp"
+#include "incremental.hpp"
+#include "keywords.hpp"
+#include "parallel.hpp"
+#include "parser.hpp"
+#include "token_cache.hpp"
+#include "tokenize.hpp"
+
+int main(int argc, char** argv) {
+	const char* filter = "";
+	const char* json = nullptr;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+			json = argv[++i];
+		else
+			filter = argv[i];
+	}
+	bool to_stdout = json != nullptr && strcmp(json, "-") == 0;
+
+	vector<bench::Result> results;
+	for (const bench::Case& c : bench::registry()) {
+		if (c.name.find(filter) == string::npos)
+			continue;
+		results.push_back(bench::run(c, 0.2));
+		if (!to_stdout)
+			bench::print(results.back());
+	}
+	if (json != nullptr) {
+		FILE* out = to_stdout ? stdout : fopen(json, "w");
+		if (out == nullptr) {
+			perror(json);
+			return 2;
+		}
+		bench::writeJson(out, results);
+		if (!to_stdout)
+			fclose(out);
+	}
+	return 0;
+}
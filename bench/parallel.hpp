@@ -0,0 +1,67 @@
+﻿/*
+* Copyright 2025 github.com/PD758
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*      http://www.apache.org/licenses/LICENSE-2.0
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#pragma once
+
+#include <cstdlib>
+#include <string>
+
+#include "bench.hpp"
+#include "tokenize.hpp"
+#include "../parallel_tokenizer.hpp"
+
+static void checkParallelAgrees(const string& source) {
+	static bool checked = false;
+	if (checked)
+		return;
+	checked = true;
+	TokenBuffer sequential, parallel;
+	tokenize(source, sequential);
+	tokenizeParallel(source, parallel, 8);
+	if (sequential.types != parallel.types || sequential.offsets != parallel.offsets
+		|| sequential.lengths != parallel.lengths || sequential.line_starts != parallel.line_starts) {
+		fprintf(stderr, "tokenizeParallel disagrees with tokenize\n");
+		exit(1);
+	}
+}
+
+// Scaling across thread counts on the same source
+static void tokenizeWithThreads(bench::State& state, size_t threads) {
+	const string& source = tokenizeBenchSource();
+	checkParallelAgrees(source);
+	TokenBuffer tokens;
+	for (size_t it = 0; it < state.iterations; it++)
+		tokenizeParallel(source, tokens, threads);
+	bench::keep(tokens.size());
+	state.items = source.size();
+	state.unit = "B";
+}
+
+BENCHMARK("tokenize_parallel/1") {
+	tokenizeWithThreads(state, 1);
+}
+BENCHMARK("tokenize_parallel/2") {
+	tokenizeWithThreads(state, 2);
+}
+BENCHMARK("tokenize_parallel/4") {
+	tokenizeWithThreads(state, 4);
+}
+BENCHMARK("tokenize_parallel/8") {
+	tokenizeWithThreads(state, 8);
+}
+BENCHMARK("tokenize_parallel/16") {
+	tokenizeWithThreads(state, 16);
+}
+BENCHMARK("tokenize_parallel/32") {
+	tokenizeWithThreads(state, 32);
+}
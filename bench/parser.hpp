@@ -0,0 +1,253 @@
+﻿/*
+* Copyright 2025 github.com/PD758
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*      http://www.apache.org/licenses/LICENSE-2.0
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "../parser.hpp"
+
+// Shape of a synthetic program: functions of typed parameters whose bodies
+// mix declarations, assignments, calls and IF/WHILE/FOR blocks nested up
+// to max_depth, with expressions expression_depth operators deep. Unlike
+// the lexer corpus every generated source parses.
+struct ProgramMix {
+	size_t max_depth = 4;
+	size_t expression_depth = 3;
+	uint32_t seed = 2025;
+	size_t size = size_t(4) << 20;	// bytes, the last function may overshoot
+};
+
+class ProgramWriter {
+public:
+	explicit ProgramWriter(const ProgramMix& mix) : mix(mix), rng(mix.seed) {
+		for (size_t i = 0; i < 48; i++) {
+			string name(1, (char)('a' + rng() % 26));
+			for (size_t length = 1 + rng() % 12; name.size() < length;)
+				name += "abcdefghijklmnopqrstuvwxyz_0123456789"[rng() % 37];
+			names.push_back(name);
+		}
+	}
+
+	string write() {
+		for (size_t i = 0; i < 8; i++)
+			out += "IMPORT " + name() + "." + name() + "\n";
+		while (out.size() < mix.size)
+			function();
+		return move(out);
+	}
+
+private:
+	const ProgramMix& mix;
+	mt19937 rng;
+	vector<string> names;
+	string out;
+
+	const string& name() {
+		return names[rng() % names.size()];
+	}
+	const char* type() {
+		const char* types[] = { "INT", "INT32", "UINT8", "FLOAT", "DOUBLE", "STRING", "CHAR", "LIST[INT]" };
+		return types[rng() % 8];
+	}
+	void indent(size_t depth) {
+		out.append(depth * 4, ' ');
+	}
+
+	void expression(size_t depth) {
+		if (depth == 0 || rng() % 4 == 0) {
+			switch (rng() % 8) {
+			case 0: out += to_string(rng() % 100000); break;
+			case 1: out += to_string(rng() % 1000) + "." + to_string(rng() % 100); break;
+			case 2: out += "\"text " + to_string(rng() % 100) + "\""; break;
+			case 3: out += rng() % 2 == 0 ? "True" : "False"; break;
+			default: out += name(); break;
+			}
+			return;
+		}
+		const char* binary[] = { "+", "-", "*", "/", "//", "%", "**", "<", "<=", ">", ">=", "==", "!=", "&&", "||", "&", "|", "^" };
+		switch (rng() % 10) {
+		case 0:
+			out += '(';
+			expression(depth - 1);
+			out += ')';
+			break;
+		case 1:
+			out += '-';
+			expression(depth - 1);
+			break;
+		case 2:
+			out += name() + '(';
+			for (size_t count = rng() % 4; count > 0; count--) {
+				expression(depth - 1);
+				if (count > 1)
+					out += ", ";
+			}
+			out += ')';
+			break;
+		case 3:
+			out += name() + '[';
+			expression(depth - 1);
+			out += "]." + name();
+			break;
+		case 4:
+			out += '[';
+			expression(depth - 1);
+			out += ", ";
+			expression(depth - 1);
+			out += ']';
+			break;
+		default:
+			expression(depth - 1);
+			out += ' ';
+			out += binary[rng() % 18];
+			out += ' ';
+			expression(depth - 1);
+			break;
+		}
+	}
+
+	void statement(size_t depth) {
+		indent(depth);
+		unsigned pick = rng() % 12;
+		if (depth < mix.max_depth && pick < 3) {
+			out += pick == 0 ? "IF " : pick == 1 ? "WHILE " : "";
+			if (pick == 2) {
+				out += "FOR INT " + name() + " = 0; ";
+				expression(1);
+				out += "; " + name() + " += 1";
+			}
+			else
+				expression(mix.expression_depth);
+			out += ":\n";
+			body(depth + 1);
+			if (pick == 0 && rng() % 2 == 0) {
+				indent(depth);
+				out += "ELSE:\n";
+				body(depth + 1);
+			}
+			return;
+		}
+		switch (pick) {
+		case 3:
+		case 4:
+			out += string(type()) + ' ' + name() + " = ";
+			expression(mix.expression_depth);
+			break;
+		case 5:
+			out += "RETURN ";
+			expression(mix.expression_depth);
+			break;
+		case 6:
+			out += name() + '(';
+			expression(mix.expression_depth - 1);
+			out += ')';
+			break;
+		default:
+			out += name() + (rng() % 3 == 0 ? " += " : " = ");
+			expression(mix.expression_depth);
+			break;
+		}
+		out += rng() % 10 == 0 ? "  # comment\n" : "\n";
+	}
+	void body(size_t depth) {
+		for (size_t count = 1 + rng() % 5; count > 0; count--)
+			statement(depth);
+	}
+	void function() {
+		out += "FUNCTION " + name() + '(';
+		for (size_t count = rng() % 4; count > 0; count--) {
+			out += string(type()) + ' ' + name();
+			if (count > 1)
+				out += ", ";
+		}
+		out += ") -> ";
+		out += type();
+		out += ":\n";
+		for (size_t count = 2 + rng() % 8; count > 0; count--)
+			statement(1);
+		out += '\n';
+	}
+};
+
+// Tokens of a generated program, made once per mix
+static const TokenBuffer& programTokens(const ProgramMix& mix) {
+	static vector<pair<const ProgramMix*, pair<string, TokenBuffer>>> cache;
+	for (const auto& entry : cache)
+		if (entry.first == &mix)
+			return entry.second.second;
+	cache.emplace_back(&mix, make_pair(ProgramWriter(mix).write(), TokenBuffer()));
+	auto& program = cache.back().second;
+	if (tokenize(program.first, program.second).is_traceback) {
+		fprintf(stderr, "the generated program does not tokenize\n");
+		exit(1);
+	}
+	return program.second;
+}
+
+// parse throughput on pre-tokenized programs, in bytes, tokens and nodes
+static void parseProgram(bench::State& state, const ProgramMix& mix) {
+	const TokenBuffer& tokens = programTokens(mix);
+	Arena arena;
+	Parser parser;
+	size_t nodes = 0;
+	for (size_t it = 0; it < state.iterations; it++) {
+		arena.reset();
+		Ast ast(arena);
+		NONE_OR_TRACEBACK res = parser.parse(tokens, ast);
+		if (res.is_traceback) {
+			cerr << "the generated program does not parse: " << res.error << endl;
+			exit(1);
+		}
+		nodes = ast.size();
+	}
+	state.items = tokens.source.size();
+	state.unit = "B";
+	state.counters.push_back({ "tokens", (double)tokens.size() });
+	state.counters.push_back({ "nodes", (double)nodes });
+}
+
+static const ProgramMix PROGRAM_MIXED;
+static const ProgramMix PROGRAM_DEEP_BLOCKS = { 24, 2 };
+static const ProgramMix PROGRAM_DEEP_EXPRESSIONS = { 2, 8 };
+
+BENCHMARK("parse/program") {
+	parseProgram(state, PROGRAM_MIXED);
+}
+
+BENCHMARK("parse/deep_blocks") {
+	parseProgram(state, PROGRAM_DEEP_BLOCKS);
+}
+
+BENCHMARK("parse/deep_expressions") {
+	parseProgram(state, PROGRAM_DEEP_EXPRESSIONS);
+}
+
+// Source to tree: tokenize and parse, the front end as a compiler runs it
+BENCHMARK("parse/tokenize_and_parse") {
+	const TokenBuffer& program = programTokens(PROGRAM_MIXED);
+	TokenBuffer tokens;
+	Arena arena;
+	for (size_t it = 0; it < state.iterations; it++) {
+		arena.reset();
+		Ast ast(arena);
+		parse(program.source, tokens, ast);
+		bench::keep(ast.root);
+	}
+	state.items = program.source.size();
+	state.unit = "B";
+}
@@ -0,0 +1,103 @@
+﻿/*
+* Copyright 2025 github.com/PD758
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*      http://www.apache.org/licenses/LICENSE-2.0
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#pragma once
+
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+
+#include "bench.hpp"
+#include "tokenize.hpp"
+#include "../token_cache.hpp"
+
+static const TokenCache& benchTokenCache() {
+	static const TokenCache cache((filesystem::temp_directory_path() / "pyrope_bench_cache").string());
+	return cache;
+}
+
+// A cache hit must give the tokens and names of a fresh lex
+static void checkTokenCacheAgrees() {
+	static bool checked = false;
+	if (checked)
+		return;
+	checked = true;
+	const string& source = tokenizeBenchSource();
+	SymbolTable lexed_names, cached_names;
+	TokenBuffer lexed, cached;
+	tokenize(source, lexed, lexed_names);
+	tokenizeCached(source, cached, benchTokenCache());	// stores the file on a miss
+	bool same = !tokenizeCached(source, cached, benchTokenCache(), &cached_names).is_traceback
+		&& lexed.types == cached.types && lexed.offsets == cached.offsets
+		&& lexed.lengths == cached.lengths && lexed.line_starts == cached.line_starts;
+	for (size_t i = 0; same && i < lexed.size(); i++)
+		same = lexed.symbol(i) == _pyrope::NO_SYMBOL ? cached.symbol(i) == _pyrope::NO_SYMBOL
+			: lexed_names.name(lexed.symbol(i)) == cached_names.name(cached.symbol(i));
+	if (!same) {
+		fprintf(stderr, "token cache disagrees with tokenize\n");
+		exit(1);
+	}
+}
+
+BENCHMARK("token_cache/cold_lex") {
+	checkTokenCacheAgrees();
+	const string& source = tokenizeBenchSource();
+	TokenBuffer tokens;
+	for (size_t it = 0; it < state.iterations; it++) {
+		SymbolTable symbols;
+		tokenize(source, tokens, symbols);
+	}
+	bench::keep(tokens.size());
+	state.items = source.size();
+	state.unit = "B";
+}
+
+// Hit through tokenizeCached: hash, map, copy into a TokenBuffer, intern names
+BENCHMARK("token_cache/warm_load") {
+	checkTokenCacheAgrees();
+	const string& source = tokenizeBenchSource();
+	TokenBuffer tokens;
+	for (size_t it = 0; it < state.iterations; it++) {
+		SymbolTable symbols;
+		tokenizeCached(source, tokens, benchTokenCache(), &symbols);
+	}
+	bench::keep(tokens.size());
+	state.items = source.size();
+	state.unit = "B";
+}
+
+// Hit used in place: hash and map only, the arrays are read from the mapping
+BENCHMARK("token_cache/warm_mmap") {
+	checkTokenCacheAgrees();
+	const string& source = tokenizeBenchSource();
+	size_t count = 0;
+	for (size_t it = 0; it < state.iterations; it++) {
+		uint64_t source_hash = hashBytes(source);
+		CachedTokens cached;
+		if (cached.open(benchTokenCache().path(source_hash), source_hash, source.size()))
+			count += cached.size();
+	}
+	bench::keep(count);
+	state.items = source.size();
+	state.unit = "B";
+}
+
+BENCHMARK("token_cache/hash") {
+	const string& source = tokenizeBenchSource();
+	uint64_t h = 0;
+	for (size_t it = 0; it < state.iterations; it++)
+		h ^= hashBytes(source);
+	bench::keep(h);
+	state.items = source.size();
+	state.unit = "B";
+}
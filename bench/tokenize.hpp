@@ -0,0 +1,184 @@
+﻿/*
+* Copyright 2025 github.com/PD758
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*      http://www.apache.org/licenses/LICENSE-2.0
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#pragma once
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+#include "../lex_stats.hpp"
+#include "../tokenizer.hpp"
+
+// Identifier-, string- and comment-heavy source with nested blocks
+static const string& tokenizeBenchSource() {
+	static const string source = [] {
+		mt19937 rng(2025);
+		const char* names[] = { "value", "counter_total", "x", "INT32", "IF", "buffer_index_long_name", "i", "RETURN" };
+		string out;
+		size_t depth = 0;
+		while (out.size() < (size_t(4) << 20)) {
+			out.append(depth * 4, ' ');
+			for (int i = 0; i < 5; i++) {
+				out += names[rng() % 8];
+				out += ' ';
+			}
+			out += "= " + to_string(rng()) + " + \"string literal number " + to_string(rng() % 1000) + "\" # comment text\n";
+			if (depth < 6 && rng() % 4 == 0)
+				depth++;
+			else if (depth > 0 && rng() % 4 == 0)
+				depth--;
+		}
+		return out;
+	}();
+	return source;
+}
+
+static void tokenizeAtLevel(bench::State& state, ScanLevel level) {
+	ScanLevel active = _pyrope::activeScanLevel();
+	if (setScanLevel(level) != level) {
+		state.items = 0;
+		return;
+	}
+	const string& source = tokenizeBenchSource();
+	vector<TokenView> tokens;
+	StringArena strings;
+	for (size_t it = 0; it < state.iterations; it++) {
+		tokens.clear();
+		tokenize(source, tokens, strings);
+	}
+	bench::keep(tokens.size());
+	_pyrope::activeScanLevel() = active;
+	state.items = source.size();
+	state.unit = "B";
+}
+
+BENCHMARK("tokenize/scalar") {
+	tokenizeAtLevel(state, ScanLevel::Scalar);
+}
+
+BENCHMARK("tokenize/sse2") {
+	tokenizeAtLevel(state, ScanLevel::SSE2);
+}
+
+BENCHMARK("tokenize/avx2") {
+	tokenizeAtLevel(state, ScanLevel::AVX2);
+}
+
+BENCHMARK("tokenize/token_buffer") {
+	const string& source = tokenizeBenchSource();
+	TokenBuffer tokens;
+	for (size_t it = 0; it < state.iterations; it++)
+		tokenize(source, tokens);
+	state.items = source.size();
+	state.unit = "B";
+	state.counters.push_back({ "tokens", (double)tokens.size() });
+}
+
+// Same source through the LexProfiler instantiation, for its overhead
+BENCHMARK("tokenize/profiled") {
+	const string& source = tokenizeBenchSource();
+	TokenBuffer tokens;
+	LexStats stats;
+	for (size_t it = 0; it < state.iterations; it++)
+		tokenizeWithStats(source, tokens, stats, nullptr, true);
+	state.items = source.size();
+	state.unit = "B";
+	state.counters.push_back({ "tokens", (double)tokens.size() });
+}
+
+// Messages with escapes, most of them repeated, as in logging-heavy scripts
+static const string& escapeBenchSource() {
+	static const string source = [] {
+		mt19937 rng(2025);
+		const char* messages[] = { "\"error:\\tvalue out of range\\n\"", "\"path \\\"C:\\\\temp\\\"\\n\"",
+			"\"\\u00e9t\\u00e9 \\x41\\x42\\n\"", "\"done\\r\\n\"" };
+		string out;
+		while (out.size() < (size_t(4) << 20)) {
+			out += "print(";
+			out += messages[rng() % 4];
+			out += ", \"plain text " + to_string(rng() % 100) + "\")\n";
+		}
+		return out;
+	}();
+	return source;
+}
+
+BENCHMARK("tokenize/string_escapes") {
+	const string& source = escapeBenchSource();
+	TokenBuffer tokens;
+	for (size_t it = 0; it < state.iterations; it++)
+		tokenize(source, tokens);
+	bench::keep(tokens.texts.size());
+	state.items = source.size();
+	state.unit = "B";
+}
+
+// The benchmark source with a stray character on every 200th line: one
+// recovering pass reports all of them
+BENCHMARK("tokenize/all_errors") {
+	static const string source = [] {
+		string out = tokenizeBenchSource();
+		size_t line = 0;
+		for (size_t i = 0; i < out.size(); i++)
+			if (out[i] == '\n' && ++line % 200 == 0 && i + 1 < out.size())
+				out.insert(i + 1 + out.find_first_not_of(' ', i + 1) - (i + 1), "$");
+		return out;
+	}();
+	TokenBuffer tokens;
+	Diagnostics diagnostics;
+	for (size_t it = 0; it < state.iterations; it++) {
+		diagnostics.clear();
+		tokenizeAll(source, tokens, diagnostics);
+	}
+	bench::keep(diagnostics.size());
+	state.items = source.size();
+	state.unit = "B";
+}
+
+// Type-only pass: deepest INDENT/DEDENT nesting
+template<typename GetType>
+static size_t maxIndentDepth(size_t count, GetType type) {
+	size_t depth = 0, max_depth = 0;
+	for (size_t i = 0; i < count; i++) {
+		TokenType t = type(i);
+		if (t == TokenType::INDENT && ++depth > max_depth)
+			max_depth = depth;
+		else if (t == TokenType::DEDENT)
+			depth--;
+	}
+	return max_depth;
+}
+
+BENCHMARK("scan_types/vector<Token>") {
+	static vector<Token> tokens;
+	if (tokens.empty()) {
+		string source = tokenizeBenchSource();
+		tokenize(source, tokens);
+	}
+	for (size_t it = 0; it < state.iterations; it++)
+		bench::keep(maxIndentDepth(tokens.size(), [&](size_t i) { return tokens[i].type; }));
+	state.items = tokens.size();
+	state.unit = "tokens";
+}
+
+BENCHMARK("scan_types/TokenBuffer") {
+	static TokenBuffer tokens;
+	if (tokens.empty())
+		tokenize(tokenizeBenchSource(), tokens);
+	for (size_t it = 0; it < state.iterations; it++)
+		bench::keep(maxIndentDepth(tokens.size(), [&](size_t i) { return tokens.types[i]; }));
+	state.items = tokens.size();
+	state.unit = "tokens";
+}
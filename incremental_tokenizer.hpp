@@ -0,0 +1,247 @@
+﻿/*
+* Copyright 2025 github.com/PD758
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*      http://www.apache.org/licenses/LICENSE-2.0
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "tokenizer.hpp"
+
+using namespace std;
+
+namespace _pyrope {
+	// Replacement of removed bytes at offset by inserted
+	struct TextEdit {
+		size_t offset = 0;
+		size_t removed = 0;
+		string_view inserted;
+	};
+
+	inline void applyEdit(string& source, const TextEdit& edit) {
+		source.replace(edit.offset, edit.removed, edit.inserted.data(), edit.inserted.size());
+	}
+
+	// First token of the line lexing restarts on: the one after the last
+	// NEWLINE before offset, so nothing lexed before it can see the edit
+	inline size_t restartToken(const TokenBuffer& tokens, size_t offset) {
+		size_t i = lower_bound(tokens.offsets.begin(), tokens.offsets.end(), (uint32_t)offset) - tokens.offsets.begin();
+		while (i > 0 && tokens.types[i - 1] != TokenType::NEWLINE)
+			i--;
+		return i;
+	}
+
+	// Indent stack in effect before tokens[index], collected backwards from
+	// the INDENT widths up to a line that starts a token at column 1.
+	// Only source before tokens[index] is read.
+	inline IndentStack indentStackAt(const TokenBuffer& tokens, string_view source, size_t index) {
+		vector<size_t> open;
+		size_t closed = 0;
+		for (size_t i = index; i-- > 0;) {
+			TokenType type = tokens.types[i];
+			if (type == TokenType::DEDENT)
+				closed++;
+			else if (type == TokenType::INDENT) {
+				if (closed > 0)
+					closed--;
+				else
+					open.push_back(tokens.values[i]);
+			}
+			else if ((i == 0 || tokens.types[i - 1] == TokenType::NEWLINE)
+				&& (tokens.offsets[i] == 0 || source[tokens.offsets[i] - 1] == '\n'))
+				break;
+		}
+		IndentStack indentStack;
+		indentStack.push(0);
+		for (size_t i = open.size(); i-- > 0;)
+			indentStack.push(open[i]);
+		return indentStack;
+	}
+
+	// Replaces target[from, to) with values, moving the tail at most once
+	template<typename T>
+	inline void spliceRange(vector<T>& target, size_t from, size_t to, const vector<T>& values) {
+		size_t common = min(to - from, values.size());
+		copy(values.begin(), values.begin() + common, target.begin() + from);
+		if (common < values.size())
+			target.insert(target.begin() + to, values.begin() + common, values.end());
+		else
+			target.erase(target.begin() + from + common, target.begin() + to);
+	}
+
+	template<typename T>
+	inline void shiftFrom(vector<T>& values, size_t from, ptrdiff_t delta) {
+		if (delta == 0)
+			return;
+		for (size_t i = from; i < values.size(); i++)
+			values[i] = (T)(values[i] + delta);
+	}
+
+	// Tokens whose value indexes a side array: numbers and texts
+	inline bool indexesNumbers(const TokenBuffer& tokens, size_t index) {
+		return isNumberLiteral(tokens.types[index]);
+	}
+	inline bool indexesTexts(const TokenBuffer& tokens, size_t index) {
+		return tokens.types[index] == TokenType::LiteralString && tokens.values[index] != NO_SYMBOL;
+	}
+
+	// Side array entries are in token order, so the entries of the replaced
+	// tokens [restart, tail) give way to the fresh ones. Returns how far the
+	// entries of the tail move.
+	template<typename T, typename Indexes>
+	inline ptrdiff_t spliceEntries(vector<T>& entries, const TokenBuffer& tokens, size_t restart, size_t tail,
+				TokenBuffer& fresh, const vector<T>& fresh_entries, Indexes indexes) {
+		size_t first = entries.size(), removed = 0;
+		for (size_t i = restart; !entries.empty() && i < tokens.size(); i++)
+			if (indexes(tokens, i)) {
+				first = tokens.values[i];
+				break;
+			}
+		for (size_t i = restart; i < tail; i++)
+			removed += indexes(tokens, i);
+		for (size_t i = 0; i < fresh.size(); i++)
+			if (indexes(fresh, i))
+				fresh.values[i] += (uint32_t)first;
+		spliceRange(entries, first, first + removed, fresh_entries);
+		return (ptrdiff_t)fresh_entries.size() - (ptrdiff_t)removed;
+	}
+
+	// Moves the tokens from index on by delta bytes, and their side array
+	// indexes by number_delta and text_delta entries
+	inline void shiftTail(TokenBuffer& tokens, size_t from, ptrdiff_t delta,
+				ptrdiff_t number_delta, ptrdiff_t text_delta) {
+		if (number_delta == 0 && text_delta == 0) {
+			shiftFrom(tokens.offsets, from, delta);
+			return;
+		}
+		for (size_t i = from; i < tokens.size(); i++) {
+			tokens.offsets[i] = (uint32_t)(tokens.offsets[i] + delta);
+			if (indexesNumbers(tokens, i))
+				tokens.values[i] = (uint32_t)(tokens.values[i] + number_delta);
+			else if (indexesTexts(tokens, i))
+				tokens.values[i] = (uint32_t)(tokens.values[i] + text_delta);
+		}
+	}
+
+	template<typename Scan>
+	NONE_OR_TRACEBACK retokenizeWith(TokenBuffer& tokens, string_view source,
+				const TextEdit& edit, SymbolTable* symbols) {
+		if (edit.offset + edit.removed > tokens.source.size()
+			|| source.size() != tokens.source.size() - edit.removed + edit.inserted.size())
+			throw invalid_argument("retokenize: edit does not match the sources");
+		size_t count = tokens.size();
+		if (count == 0 || tokens.types[count - 1] != TokenType::END_OF_FILE) {
+			// no complete stream to resynchronize with
+			tokens.reset(source);
+			return tokenizeWith<Scan>(source, tokens, symbols);
+		}
+		if (source.size() > UINT32_MAX)
+			throw length_error("TokenBuffer: source larger than 4 GiB");
+
+		ptrdiff_t delta = (ptrdiff_t)edit.inserted.size() - (ptrdiff_t)edit.removed;
+		size_t edit_end = edit.offset + edit.inserted.size();
+		size_t restart = restartToken(tokens, edit.offset);
+		size_t first_line = restart == 0 ? 1 : tokens.line(restart - 1) + 1;
+
+		// lines are counted from first_line, as in a chunk of tokenizeParallel
+		LexState state;
+		state.current = state.line_start = tokens.line_starts[first_line - 1];
+		state.indentStack = indentStackAt(tokens, source, restart);
+		TokenBuffer fresh;
+		fresh.source = source;
+		fresh.line_starts.assign(1, (uint32_t)state.line_start);
+
+		// Lex line by line; past the edit, the old and new streams agree from
+		// the first NEWLINE both have at the same text with the same indent stack
+		size_t old_index = restart;
+		IndentStack old_stack = state.indentStack;
+		size_t resync = count;
+		NONE_OR_TRACEBACK res = NONE_OR_TRACEBACK(0);
+		while (state.current < source.size()) {
+			size_t newline = source.find('\n', state.current);
+			size_t limit = newline == string_view::npos ? source.size() : newline + 1;
+			res = lexUntil<Scan>(state, source, limit, fresh, symbols);
+			if (res.is_traceback)
+				break;
+			if (fresh.empty())
+				continue;
+			size_t last = fresh.size() - 1;
+			if (fresh.types[last] != TokenType::NEWLINE
+				|| fresh.offsets[last] + 1 != state.current || fresh.offsets[last] < edit_end)
+				continue;
+			size_t old_newline = (size_t)((ptrdiff_t)fresh.offsets[last] - delta);
+			for (; old_index < count && tokens.offsets[old_index] < old_newline; old_index++) {
+				if (tokens.types[old_index] == TokenType::INDENT)
+					old_stack.push(tokens.values[old_index]);
+				else if (tokens.types[old_index] == TokenType::DEDENT)
+					old_stack.pop();
+			}
+			if (old_index < count && tokens.offsets[old_index] == old_newline
+				&& tokens.types[old_index] == TokenType::NEWLINE && old_stack == state.indentStack) {
+				resync = old_index;
+				break;
+			}
+		}
+
+		size_t tail = count, tail_line = tokens.line_starts.size();
+		if (res.is_traceback)
+			res.error.line += first_line - 1;
+		else if (resync < count) {
+			tail = resync + 1;
+			tail_line = tokens.line(resync) + 1;
+		}
+		else
+			lexFinish(state, fresh);
+
+		// decoded strings move to the storage of tokens, which keeps the
+		// replaced ones until its next reset
+		for (string_view& text : fresh.texts)
+			text = tokens.strings.intern(text);
+		ptrdiff_t number_delta = spliceEntries(tokens.numbers, tokens, restart, tail, fresh, fresh.numbers, indexesNumbers);
+		ptrdiff_t text_delta = spliceEntries(tokens.texts, tokens, restart, tail, fresh, fresh.texts, indexesTexts);
+
+		tokens.source = source;
+		spliceRange(tokens.types, restart, tail, fresh.types);
+		spliceRange(tokens.offsets, restart, tail, fresh.offsets);
+		spliceRange(tokens.lengths, restart, tail, fresh.lengths);
+		spliceRange(tokens.values, restart, tail, fresh.values);
+		shiftTail(tokens, restart + fresh.size(), delta, number_delta, text_delta);
+		spliceRange(tokens.line_starts, first_line - 1, tail_line, fresh.line_starts);
+		shiftFrom(tokens.line_starts, first_line - 1 + fresh.line_starts.size(), delta);
+		return res;
+	}
+
+	// Brings tokens, the buffer of the source before edit, up to date with
+	// source, the text after it. Only the lines from the one holding the
+	// edit to the first line where the lexer state matches the old stream
+	// again are lexed; tokens after that are kept with their offsets
+	// shifted. The old text need not be alive, and the result, tracebacks
+	// included, is the one tokenize gives for source. symbols must be the
+	// table tokens was lexed with, if any.
+	inline NONE_OR_TRACEBACK retokenize(TokenBuffer& tokens, string_view source,
+				const TextEdit& edit, SymbolTable* symbols = nullptr) {
+		switch (activeScanLevel().load(memory_order_relaxed)) {
+#ifdef PYROPE_SCAN_X86
+		case ScanLevel::AVX2:
+			return retokenizeWith<Avx2Scan>(tokens, source, edit, symbols);
+		case ScanLevel::SSE2:
+			return retokenizeWith<Sse2Scan>(tokens, source, edit, symbols);
+#endif
+		default:
+			return retokenizeWith<ScalarScan>(tokens, source, edit, symbols);
+		}
+	}
+}
+
+using _pyrope::TextEdit, _pyrope::applyEdit, _pyrope::retokenize;
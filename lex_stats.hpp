@@ -0,0 +1,206 @@
+﻿/*
+* Copyright 2025 github.com/PD758
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*      http://www.apache.org/licenses/LICENSE-2.0
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+#include "tokenizer.hpp"
+
+using namespace std;
+
+namespace _pyrope {
+	inline constexpr size_t TOKEN_TYPE_COUNT = (size_t)TokenType::UNKNOWN + 1;
+
+	// What lexing a set of sources produced and, when profiled, where the
+	// time went. Counts add up over every source given to tokenizeWithStats.
+	struct LexStats {
+		uint64_t tokens[TOKEN_TYPE_COUNT] = {};
+		uint64_t bytes[TOKEN_TYPE_COUNT] = {};		// lexeme bytes per type, 1 per NEWLINE
+		uint64_t sources = 0;
+		uint64_t source_bytes = 0;
+		uint64_t lines = 0;
+		size_t max_indent_depth = 0;
+		size_t longest_line = 0;					// bytes, without the line break
+		size_t longest_token = 0;
+		uint64_t nanoseconds = 0;					// whole tokenize calls
+		uint64_t phase_nanoseconds[LEX_PHASE_COUNT] = {};
+		bool profiled = false;						// phase_nanoseconds was measured
+
+		static const char* phaseName(LexPhase phase) {
+			switch (phase) {
+			case LexPhase::Indentation:
+				return "indentation";
+			case LexPhase::Identifiers:
+				return "identifiers";
+			case LexPhase::Literals:
+				return "literals";
+			default:
+				return "operators";
+			}
+		}
+
+		uint64_t tokenCount() const {
+			uint64_t total = 0;
+			for (uint64_t count : tokens)
+				total += count;
+			return total;
+		}
+		void clear() {
+			*this = LexStats();
+		}
+
+		// Counts the tokens of one source, given their types and lexeme lengths
+		template<typename GetType, typename GetLength>
+		void count(string_view source, size_t token_count, GetType type, GetLength length) {
+			size_t depth = 0;
+			for (size_t i = 0; i < token_count; i++) {
+				TokenType t = type(i);
+				// a NEWLINE's lexeme is the two-character "\\n" it is shown as
+				size_t bytes_of = t == TokenType::NEWLINE ? 1 : length(i);
+				tokens[(size_t)t]++;
+				bytes[(size_t)t] += bytes_of;
+				longest_token = max(longest_token, bytes_of);
+				if (t == TokenType::INDENT)
+					max_indent_depth = max(max_indent_depth, ++depth);
+				else if (t == TokenType::DEDENT && depth > 0)
+					depth--;
+			}
+			sources++;
+			source_bytes += source.size();
+			const char* p = source.data();
+			const char* const end = p + source.size();
+			while (p < end) {
+				const char* eol = (const char*)memchr(p, '\n', end - p);
+				const char* line_end = eol != nullptr ? eol : end;
+				size_t width = line_end - p;
+				if (width > 0 && line_end[-1] == '\r')
+					width--;
+				longest_line = max(longest_line, width);
+				lines++;
+				p = eol != nullptr ? eol + 1 : end;
+			}
+		}
+
+		void text(ostream& os) const {
+			os << "sources: " << sources << ", " << source_bytes << " bytes, " << lines << " lines\n"
+				<< "tokens: " << tokenCount() << "\n";
+			for (size_t i = 0; i < TOKEN_TYPE_COUNT; i++)
+				if (tokens[i] > 0)
+					os << "  " << tokenTypeName((TokenType)i) << ": " << tokens[i] << " tokens, " << bytes[i] << " bytes\n";
+			os << "max indent depth: " << max_indent_depth << "\n"
+				<< "longest line: " << longest_line << " bytes\n"
+				<< "longest token: " << longest_token << " bytes\n"
+				<< "time: " << nanoseconds / 1000 << " us";
+			if (nanoseconds > 0)
+				os << ", " << (double)source_bytes * 1000 / nanoseconds << " MB/s";
+			os << "\n";
+			if (!profiled)
+				return;
+			uint64_t phases = 0;
+			for (size_t i = 0; i < LEX_PHASE_COUNT; i++) {
+				os << "  " << phaseName((LexPhase)i) << ": " << phase_nanoseconds[i] / 1000 << " us\n";
+				phases += phase_nanoseconds[i];
+			}
+			os << "  other: " << (nanoseconds > phases ? nanoseconds - phases : 0) / 1000 << " us\n";
+		}
+		void json(ostream& os) const {
+			os << "{\"sources\":" << sources << ",\"source_bytes\":" << source_bytes << ",\"lines\":" << lines
+				<< ",\"max_indent_depth\":" << max_indent_depth << ",\"longest_line\":" << longest_line
+				<< ",\"longest_token\":" << longest_token << ",\"nanoseconds\":" << nanoseconds << ",\"types\":{";
+			for (size_t i = 0; i < TOKEN_TYPE_COUNT; i++)
+				os << (i > 0 ? "," : "") << "\"" << tokenTypeName((TokenType)i) << "\":{\"tokens\":" << tokens[i]
+					<< ",\"bytes\":" << bytes[i] << "}";
+			os << "}";
+			if (profiled) {
+				os << ",\"phases\":{";
+				for (size_t i = 0; i < LEX_PHASE_COUNT; i++)
+					os << (i > 0 ? "," : "") << "\"" << phaseName((LexPhase)i) << "\":" << phase_nanoseconds[i];
+				os << "}";
+			}
+			os << "}";
+		}
+	};
+
+	// Stats policy of the lexer that times every phase into a LexStats.
+	// Two clock reads per token, so the profiled lexer is measurably slower
+	// than the plain one; the split between phases is what it is for.
+	struct LexProfiler {
+		LexStats& stats;
+
+		struct Scope {
+			LexProfiler& profiler;
+			LexPhase phase;
+			chrono::steady_clock::time_point start;
+
+			Scope(LexProfiler& profiler, LexPhase phase) : profiler(profiler), phase(phase),
+				start(chrono::steady_clock::now()) {}
+			~Scope() {
+				profiler.stats.phase_nanoseconds[(size_t)phase] += (uint64_t)chrono::duration_cast<chrono::nanoseconds>(
+					chrono::steady_clock::now() - start).count();
+			}
+		};
+	};
+
+	template<typename Tokens>
+	NONE_OR_TRACEBACK lexWithStats(string_view source, Tokens& tokens, LexStats& stats, SymbolTable* symbols, bool profile,
+				StringArena* strings = nullptr) {
+		auto start = chrono::steady_clock::now();
+		LexProfiler profiler{ stats };
+		stats.profiled |= profile;
+		NONE_OR_TRACEBACK res = profile
+			? tokenizeInto(source, tokens, symbols, nullptr, &profiler, strings)
+			: tokenizeInto<Tokens, NoLexStats>(source, tokens, symbols, nullptr, nullptr, strings);
+		stats.nanoseconds += (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+		return res;
+	}
+
+	// tokenize that adds what it lexed to stats. With profile the lexer is
+	// instantiated with LexProfiler and stats gets the time of every phase;
+	// without it the plain lexer runs and only counts are gathered, after
+	// the tokens are out.
+	template<typename TokenT>
+	NONE_OR_TRACEBACK tokenizeWithStats(string_view source, vector<TokenT>& tokens, LexStats& stats,
+				SymbolTable* symbols = nullptr, bool profile = false) {
+		static_assert(KEEPS_DECODED_STRINGS<TokenT>, "TokenView tokens need a StringArena for decoded string literals");
+		size_t first = tokens.size();
+		NONE_OR_TRACEBACK res = lexWithStats(source, tokens, stats, symbols, profile);
+		stats.count(source, tokens.size() - first, [&](size_t i) { return tokens[first + i].type; },
+			[&](size_t i) { return tokens[first + i].lexeme.size(); });
+		return res;
+	}
+	NONE_OR_TRACEBACK tokenizeWithStats(string_view source, vector<TokenView>& tokens, LexStats& stats,
+				StringArena& strings, SymbolTable* symbols = nullptr, bool profile = false) {
+		size_t first = tokens.size();
+		NONE_OR_TRACEBACK res = lexWithStats(source, tokens, stats, symbols, profile, &strings);
+		stats.count(source, tokens.size() - first, [&](size_t i) { return tokens[first + i].type; },
+			[&](size_t i) { return tokens[first + i].lexeme.size(); });
+		return res;
+	}
+	NONE_OR_TRACEBACK tokenizeWithStats(string_view source, TokenBuffer& tokens, LexStats& stats,
+				SymbolTable* symbols = nullptr, bool profile = false) {
+		tokens.reset(source);
+		NONE_OR_TRACEBACK res = lexWithStats(source, tokens, stats, symbols, profile);
+		stats.count(source, tokens.size(), [&](size_t i) { return tokens.types[i]; },
+			[&](size_t i) { return tokens.lexeme(i).size(); });
+		return res;
+	}
+}
+
+using _pyrope::LexStats, _pyrope::tokenizeWithStats;
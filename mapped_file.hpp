@@ -0,0 +1,145 @@
+﻿/*
+* Copyright 2025 github.com/PD758
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*      http://www.apache.org/licenses/LICENSE-2.0
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace _pyrope {
+	// Read-only memory mapping of a whole file, so it can be lexed in place
+	// without being copied into a string. Throws runtime_error if the file
+	// cannot be opened or mapped.
+	class MappedFile {
+	public:
+		MappedFile() {}
+		explicit MappedFile(const string& path) {
+			open(path);
+		}
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		~MappedFile() {
+			close();
+		}
+
+		void open(const string& path) {
+			close();
+#ifdef _WIN32
+			file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+				OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if (file == INVALID_HANDLE_VALUE)
+				fail("cannot open", path);
+			LARGE_INTEGER file_size;
+			if (!GetFileSizeEx(file, &file_size))
+				fail("cannot stat", path);
+			length = (size_t)file_size.QuadPart;
+			if (length == 0)
+				return;
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mapping == nullptr)
+				fail("cannot map", path);
+			address = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			if (address == nullptr)
+				fail("cannot map", path);
+#else
+			fd = ::open(path.c_str(), O_RDONLY);
+			if (fd < 0)
+				fail("cannot open", path);
+			struct stat info;
+			if (fstat(fd, &info) != 0)
+				fail("cannot stat", path);
+			length = (size_t)info.st_size;
+			if (length == 0)
+				return;
+			void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (mapped == MAP_FAILED)
+				fail("cannot map", path);
+			address = (const char*)mapped;
+			madvise(mapped, length, MADV_SEQUENTIAL);
+#endif
+		}
+
+		void close() {
+#ifdef _WIN32
+			if (address != nullptr)
+				UnmapViewOfFile(address);
+			if (mapping != nullptr)
+				CloseHandle(mapping);
+			if (file != INVALID_HANDLE_VALUE)
+				CloseHandle(file);
+			mapping = nullptr;
+			file = INVALID_HANDLE_VALUE;
+#else
+			if (address != nullptr)
+				munmap((void*)address, length);
+			if (fd >= 0)
+				::close(fd);
+			fd = -1;
+#endif
+			address = nullptr;
+			length = 0;
+		}
+
+		const char* data() const {
+			return address;
+		}
+		size_t size() const {
+			return length;
+		}
+		string_view view() const {
+			return address != nullptr ? string_view(address, length) : string_view();
+		}
+
+	private:
+		const char* address = nullptr;
+		size_t length = 0;
+#ifdef _WIN32
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = nullptr;
+#else
+		int fd = -1;
+#endif
+
+		[[noreturn]] void fail(const char* what, const string& path) {
+#ifdef _WIN32
+			string reason = "error " + to_string(GetLastError());
+#else
+			string reason = strerror(errno);
+#endif
+			close();
+			throw runtime_error(string(what) + " " + path + ": " + reason);
+		}
+	};
+}
+
+using _pyrope::MappedFile;
@@ -0,0 +1,263 @@
+﻿/*
+* Copyright 2025 github.com/PD758
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*      http://www.apache.org/licenses/LICENSE-2.0
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#pragma once
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "tokenizer.hpp"
+
+using namespace std;
+
+namespace _pyrope {
+	// Chunks smaller than this are not worth a thread
+	inline constexpr size_t MIN_PARALLEL_CHUNK = 256 * 1024;
+
+	// First position at or after from that starts a line the lexer reaches
+	// with a fresh state. Only a char literal can hold a raw newline, and then
+	// the newline follows a quote or a backslash, so such newlines are skipped.
+	inline size_t nextChunkBoundary(string_view source, size_t from) {
+		size_t newline = source.find('\n', from);
+		while (newline != string_view::npos && newline > 0
+			&& (source[newline - 1] == '\'' || source[newline - 1] == '\\'))
+			newline = source.find('\n', newline + 1);
+		return newline == string_view::npos ? source.size() : newline + 1;
+	}
+
+	// line_start the lexer holds after the newline ending just before begin:
+	// lines of spaces, possibly followed by a comment, leave it on the newline
+	inline size_t chunkLineStart(string_view source, size_t begin) {
+		if (begin == 0)
+			return 0;
+		size_t newline = begin - 1;
+		size_t previous = newline == 0 ? string_view::npos : source.rfind('\n', newline - 1);
+		size_t i = previous == string_view::npos ? 0 : previous + 1;
+		while (source[i] == ' ')
+			i++;
+		return (source[i] == '\n' || source[i] == '#') ? newline : begin;
+	}
+
+	template<typename Tokens>
+	struct LexChunk {
+		size_t begin = 0;
+		size_t end = 0;
+		Tokens tokens;
+		vector<IndentMark> marks;
+		LexState state;
+		StringArena strings;	// decoded string literals of TokenView chunks
+		NONE_OR_TRACEBACK result = NONE_OR_TRACEBACK(0);
+	};
+
+	// Chunk storage: token vectors need nothing, a TokenBuffer needs the line
+	// the chunk starts on so that offsets stay absolute
+	template<typename TokenT>
+	inline void beginChunk(vector<TokenT>&, string_view, size_t) {}
+	inline void beginChunk(TokenBuffer& tokens, string_view source, size_t line_start) {
+		tokens.source = source;
+		tokens.line_starts.assign(1, (uint32_t)line_start);
+	}
+
+	// Appends raw chunk tokens [from, to) with lines counted from line_base
+	template<typename TokenT>
+	inline void appendChunkTokens(vector<TokenT>& out, const vector<TokenT>& chunk,
+				size_t from, size_t to, size_t line_base) {
+		for (size_t i = from; i < to; i++) {
+			out.push_back(chunk[i]);
+			out.back().line += line_base;
+		}
+	}
+	inline void appendChunkTokens(TokenBuffer& out, const TokenBuffer& chunk,
+				size_t from, size_t to, size_t) {
+		size_t first = out.size();
+		out.types.insert(out.types.end(), chunk.types.begin() + from, chunk.types.begin() + to);
+		out.offsets.insert(out.offsets.end(), chunk.offsets.begin() + from, chunk.offsets.begin() + to);
+		out.lengths.insert(out.lengths.end(), chunk.lengths.begin() + from, chunk.lengths.begin() + to);
+		out.values.insert(out.values.end(), chunk.values.begin() + from, chunk.values.begin() + to);
+		// number literals and decoded strings move from the chunk's side
+		// arrays to the end of out's
+		for (size_t i = first; i < out.size(); i++)
+			if (isNumberLiteral(out.types[i])) {
+				out.numbers.push_back(chunk.numbers[out.values[i]]);
+				out.values[i] = (uint32_t)(out.numbers.size() - 1);
+			}
+			else if (out.types[i] == TokenType::LiteralString && out.values[i] != NO_SYMBOL) {
+				out.texts.push_back(out.strings.intern(chunk.texts[out.values[i]]));
+				out.values[i] = (uint32_t)(out.texts.size() - 1);
+			}
+	}
+
+	// Line starts of the chunk, minus the first one already recorded before it
+	template<typename TokenT>
+	inline void appendChunkLines(vector<TokenT>&, const vector<TokenT>&) {}
+	inline void appendChunkLines(TokenBuffer& out, const TokenBuffer& chunk) {
+		out.line_starts.insert(out.line_starts.end(), chunk.line_starts.begin() + 1, chunk.line_starts.end());
+	}
+
+	// Drops line starts recorded past a traceback, as tokenize stops there
+	template<typename TokenT>
+	inline void endChunkLines(vector<TokenT>&, size_t) {}
+	inline void endChunkLines(TokenBuffer& tokens, size_t line) {
+		tokens.line_starts.resize(line);
+	}
+
+	// Workers lex without a symbol table; names are interned here, in order
+	template<typename TokenT>
+	inline void internNames(vector<TokenT>& tokens, size_t from, SymbolTable& symbols) {
+		for (size_t i = from; i < tokens.size(); i++)
+			if (tokens[i].type == TokenType::Identifier)
+				tokens[i].symbol = symbols.intern(tokens[i].lexeme);
+	}
+	inline void internNames(TokenBuffer& tokens, size_t from, SymbolTable& symbols) {
+		for (size_t i = from; i < tokens.size(); i++)
+			if (tokens.types[i] == TokenType::Identifier)
+				tokens.values[i] = symbols.intern(tokens.lexeme(i));
+	}
+
+	// Decoded string literals of TokenView tokens point into the arena of
+	// their chunk, which goes away with it; they are copied to strings here
+	template<typename TokenT>
+	inline void internStrings(vector<TokenT>&, size_t, string_view, StringArena*) {}
+	inline void internStrings(vector<TokenView>& tokens, size_t from, string_view source, StringArena* strings) {
+		uintptr_t begin = (uintptr_t)source.data();
+		for (size_t i = from; i < tokens.size(); i++) {
+			string_view& lexeme = tokens[i].lexeme;
+			uintptr_t at = (uintptr_t)lexeme.data();
+			if (tokens[i].type == TokenType::LiteralString && (at < begin || at - begin > source.size()))
+				lexeme = strings->intern(lexeme);
+		}
+	}
+	inline void internStrings(TokenBuffer&, size_t, string_view, StringArena*) {}
+
+	template<typename Tokens>
+	inline size_t beginTokens(Tokens& tokens, string_view) {
+		return tokens.size();
+	}
+	inline size_t beginTokens(TokenBuffer& tokens, string_view source) {
+		tokens.reset(source);
+		return 0;
+	}
+
+	template<typename Scan, typename Tokens>
+	void lexChunk(string_view source, LexChunk<Tokens>& chunk) {
+		chunk.state.current = chunk.begin;
+		chunk.state.line_start = chunkLineStart(source, chunk.begin);
+		chunk.state.indent_marks = &chunk.marks;
+		chunk.state.strings = &chunk.strings;
+		beginChunk(chunk.tokens, source, chunk.state.line_start);
+		chunk.result = lexUntil<Scan>(chunk.state, source, chunk.end, chunk.tokens, nullptr);
+	}
+
+	template<typename Scan, typename Tokens>
+	NONE_OR_TRACEBACK tokenizeParallelWith(string_view source, Tokens& tokens,
+				size_t threads, SymbolTable* symbols, StringArena* strings) {
+		size_t first_token = beginTokens(tokens, source);
+
+		// cut at line boundaries, one chunk per thread
+		size_t count = max<size_t>(1, min(threads, source.size() / MIN_PARALLEL_CHUNK));
+		vector<LexChunk<Tokens>> chunks;
+		chunks.reserve(count);
+		size_t begin = 0;
+		do {
+			size_t end = source.size();
+			if (chunks.size() + 1 < count)
+				end = nextChunkBoundary(source, max(begin, source.size() / count * (chunks.size() + 1)));
+			chunks.emplace_back();
+			chunks.back().begin = begin;
+			chunks.back().end = end;
+			begin = end;
+		} while (begin < source.size());
+
+		vector<thread> workers;
+		for (size_t i = 1; i < chunks.size(); i++)
+			workers.emplace_back(lexChunk<Scan, Tokens>, source, ref(chunks[i]));
+		lexChunk<Scan>(source, chunks[0]);
+		for (thread& worker : workers)
+			worker.join();
+
+		// replay the indentation of every line start in source order
+		IndentStack indentStack;
+		indentStack.push(0);
+		size_t line_base = 0;
+		NONE_OR_TRACEBACK res = NONE_OR_TRACEBACK(0);
+		for (LexChunk<Tokens>& chunk : chunks) {
+			appendChunkLines(tokens, chunk.tokens);
+			size_t next = 0;
+			for (const IndentMark& mark : chunk.marks) {
+				appendChunkTokens(tokens, chunk.tokens, next, mark.token_index, line_base);
+				next = mark.token_index;
+				res = checkIndent(indentStack, tokens, mark.width,
+					source.substr(mark.offset, mark.width), line_base + mark.line, mark.column);
+				if (res.is_traceback)
+					break;
+			}
+			if (res.is_traceback)
+				break;
+			appendChunkTokens(tokens, chunk.tokens, next, chunk.tokens.size(), line_base);
+			if (chunk.result.is_traceback) {
+				res = chunk.result;
+				res.error.line += line_base;
+				break;
+			}
+			line_base += chunk.state.line - 1;
+		}
+
+		internStrings(tokens, first_token, source, strings);
+		if (symbols != nullptr)
+			internNames(tokens, first_token, *symbols);
+		if (res.is_traceback) {
+			endChunkLines(tokens, res.error.line);
+			return res;
+		}
+
+		LexState last = chunks.back().state;
+		last.line = line_base + 1;
+		last.indentStack = indentStack;
+		lexFinish(last, tokens);
+		return NONE_OR_TRACEBACK(0);
+	}
+
+	template<typename Tokens>
+	NONE_OR_TRACEBACK tokenizeParallelInto(string_view source, Tokens& tokens,
+				size_t threads, SymbolTable* symbols, StringArena* strings) {
+		switch (activeScanLevel().load(memory_order_relaxed)) {
+#ifdef PYROPE_SCAN_X86
+		case ScanLevel::AVX2:
+			return tokenizeParallelWith<Avx2Scan>(source, tokens, threads, symbols, strings);
+		case ScanLevel::SSE2:
+			return tokenizeParallelWith<Sse2Scan>(source, tokens, threads, symbols, strings);
+#endif
+		default:
+			return tokenizeParallelWith<ScalarScan>(source, tokens, threads, symbols, strings);
+		}
+	}
+
+	// tokenize split over up to threads threads: chunks are cut at line
+	// boundaries and lexed independently with their indentation deferred,
+	// then INDENT/DEDENT tokens and line numbers are fixed up in one sequential
+	// pass. The result, tracebacks included, is the one tokenize gives.
+	template<typename Tokens>
+	NONE_OR_TRACEBACK tokenizeParallel(string_view source, Tokens& tokens,
+				size_t threads = thread::hardware_concurrency(), SymbolTable* symbols = nullptr) {
+		static_assert(!is_same_v<Tokens, vector<TokenView>>, "TokenView tokens need a StringArena for decoded string literals");
+		return tokenizeParallelInto(source, tokens, threads, symbols, nullptr);
+	}
+	// Decoded string literals go to strings, the arena of the compilation
+	inline NONE_OR_TRACEBACK tokenizeParallel(string_view source, vector<TokenView>& tokens, StringArena& strings,
+				size_t threads = thread::hardware_concurrency(), SymbolTable* symbols = nullptr) {
+		return tokenizeParallelInto(source, tokens, threads, symbols, &strings);
+	}
+}
+
+using _pyrope::tokenizeParallel;
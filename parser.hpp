@@ -0,0 +1,838 @@
+﻿/*
+* Copyright 2025 github.com/PD758
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*      http://www.apache.org/licenses/LICENSE-2.0
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "allocator.hpp"
+#include "tokenizer.hpp"
+#include "traceback.hpp"
+
+using namespace std;
+
+namespace _pyrope {
+	// Node index; children are referred to by index, never by pointer
+	typedef uint32_t NodeId;
+	inline constexpr NodeId NO_NODE = UINT32_MAX;
+
+	// Layout of every kind. token is an index into the TokenBuffer the tree
+	// was parsed from, op an index into OPERATORS, and a list is rhs node
+	// ids stored in Ast::extra from lhs on, sometimes after a fixed prefix.
+	enum class NodeKind : uint8_t {
+		Program,		// list of statements
+		Block,			// token ':', list of statements
+		Function,		// token name; extra[lhs] return type or NO_NODE, extra[lhs + 1] body, then the list of Parameters
+		Parameter,		// token name, lhs type
+		TypeName,		// token type, lhs element type of LIST[...] or NO_NODE
+		Declaration,	// token name, lhs type, rhs initial value or NO_NODE
+		Assign,			// token and op the assignment, lhs target, rhs value
+		If,				// lhs condition, extra[rhs] body, extra[rhs + 1] ELSE Block, If or NO_NODE
+		While,			// lhs condition, rhs body
+		For,			// extra[lhs..lhs + 2] init, condition and step, any of them NO_NODE; rhs body
+		Return,			// lhs value or NO_NODE
+		Break,
+		Continue,
+		Import,			// list of the Names of the dotted path
+		Binary,			// token and op the operator, lhs and rhs operands
+		Unary,			// token and op the operator, lhs operand
+		Call,			// token '(', extra[lhs] callee, then the list of arguments
+		Index,			// token '[', lhs object, rhs index
+		Member,			// token the name after '.', lhs object
+		Name,			// token identifier
+		Integer,		// token the literal, as are the next four
+		Float,
+		String,
+		Char,
+		Bool,
+		List,			// token '[', list of items
+	};
+
+	struct AstNode {
+		NodeKind kind;
+		uint8_t op = 0;
+		uint32_t token;
+		NodeId lhs = NO_NODE;
+		NodeId rhs = NO_NODE;
+	};
+	static_assert(sizeof(AstNode) == 16, "AstNode should stay four words");
+
+	inline const char* nodeKindName(NodeKind kind) {
+		static const char* const names[] = { "Program", "Block", "Function", "Parameter", "TypeName", "Declaration",
+			"Assign", "If", "While", "For", "Return", "Break", "Continue", "Import", "Binary", "Unary", "Call",
+			"Index", "Member", "Name", "Integer", "Float", "String", "Char", "Bool", "List" };
+		return names[(size_t)kind];
+	}
+
+	// Syntax tree of one source as flat arrays in a per-compilation arena.
+	// The arrays are reserved from the token count, which bounds the node
+	// count, so a parse allocates once. The tree must not outlive the
+	// arena's contents: reset the arena, then make a new Ast.
+	struct Ast {
+		vector<AstNode, ArenaAllocator<AstNode>> nodes;
+		vector<NodeId, ArenaAllocator<NodeId>> extra;	// lists and fixed records of children
+		NodeId root = NO_NODE;
+
+		explicit Ast(Arena& arena) : nodes(ArenaAllocator<AstNode>(arena)), extra(ArenaAllocator<NodeId>(arena)) {}
+
+		size_t size() const {
+			return nodes.size();
+		}
+		const AstNode& operator[](NodeId node) const {
+			return nodes[node];
+		}
+		void clear() {
+			nodes.clear();
+			extra.clear();
+			root = NO_NODE;
+		}
+
+		// Calls visit(child) for every present child, in source order
+		template<typename Visit>
+		void forEachChild(NodeId id, Visit visit) const {
+			const AstNode& node = nodes[id];
+			auto list = [&](size_t start, size_t count) {
+				for (size_t i = 0; i < count; i++)
+					visit(extra[start + i]);
+			};
+			auto optional = [&](NodeId child) {
+				if (child != NO_NODE)
+					visit(child);
+			};
+			switch (node.kind) {
+			case NodeKind::Program:
+			case NodeKind::Block:
+			case NodeKind::Import:
+			case NodeKind::List:
+				list(node.lhs, node.rhs);
+				break;
+			case NodeKind::Function:
+				list(node.lhs + 2, node.rhs);
+				optional(extra[node.lhs]);
+				visit(extra[node.lhs + 1]);
+				break;
+			case NodeKind::Call:
+				visit(extra[node.lhs]);
+				list(node.lhs + 1, node.rhs);
+				break;
+			case NodeKind::If:
+				visit(node.lhs);
+				visit(extra[node.rhs]);
+				optional(extra[node.rhs + 1]);
+				break;
+			case NodeKind::For:
+				for (size_t i = 0; i < 3; i++)
+					optional(extra[node.lhs + i]);
+				visit(node.rhs);
+				break;
+			default:
+				optional(node.lhs);
+				optional(node.rhs);
+				break;
+			}
+		}
+
+		// One node per line, children indented under their parent. Walks with
+		// its own stack, so an ELSE IF chain of any length is printed; past
+		// MAX_DUMP_INDENT levels the depth is written instead of the indent.
+		static constexpr size_t MAX_DUMP_INDENT = 64;
+		void dump(ostream& os, const TokenBuffer& tokens, NodeId id = NO_NODE) const {
+			if (id == NO_NODE)
+				id = root;
+			if (id == NO_NODE)
+				return;
+			vector<pair<NodeId, size_t>> pending = { { id, 0 } };
+			vector<NodeId> children;
+			while (!pending.empty()) {
+				auto [current, depth] = pending.back();
+				pending.pop_back();
+				const AstNode& node = nodes[current];
+				os << string(min(depth, MAX_DUMP_INDENT) * 2, ' ');
+				if (depth > MAX_DUMP_INDENT)
+					os << '<' << depth << "> ";
+				os << nodeKindName(node.kind);
+				switch (node.kind) {
+				case NodeKind::Program:
+				case NodeKind::Block:
+				case NodeKind::If:
+				case NodeKind::While:
+				case NodeKind::For:
+				case NodeKind::Return:
+				case NodeKind::Break:
+				case NodeKind::Continue:
+				case NodeKind::Import:
+				case NodeKind::Call:
+				case NodeKind::Index:
+				case NodeKind::List:
+					break;
+				default:
+					os << " \"" << tokens.lexeme(node.token) << '"';
+					break;
+				}
+				os << '\n';
+				children.clear();
+				forEachChild(current, [&](NodeId child) { children.push_back(child); });
+				for (size_t i = children.size(); i > 0; i--)
+					pending.push_back({ children[i - 1], depth + 1 });
+			}
+		}
+	};
+
+	inline constexpr SymbolId keywordId(string_view text) {
+		for (SymbolId id = 0; id < KEYWORD_COUNT; id++)
+			if (KEYWORDS[id].text == text)
+				return id;
+		return NO_SYMBOL;
+	}
+	inline constexpr size_t operatorIndex(string_view text) {
+		for (size_t op = 0; op < OPERATOR_COUNT; op++)
+			if (OPERATORS[op].text == text)
+				return op;
+		return OPERATOR_COUNT;
+	}
+
+	// Binding strength of every binary operator, 0 for the others. ** is
+	// not in it: it binds tighter than unary minus and to the right.
+	struct PrecedenceTable {
+		uint8_t level[OPERATOR_COUNT] = {};
+
+		static constexpr PrecedenceTable build() {
+			PrecedenceTable table;
+			const string_view levels[][4] = {
+				{ "||" }, { "&&" }, { "|" }, { "^" }, { "&" }, { "==", "!=" },
+				{ "<", "<=", ">", ">=" }, { "+", "-" }, { "*", "/", "//", "%" },
+			};
+			for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i++)
+				for (string_view text : levels[i])
+					if (!text.empty())
+						table.level[operatorIndex(text)] = (uint8_t)(i + 1);
+			return table;
+		}
+	};
+	inline constexpr PrecedenceTable BINARY_PRECEDENCE = PrecedenceTable::build();
+
+	// Recursive descent over a TokenBuffer. Statements are dispatched on the
+	// keyword id the lexer stored, operators on their OPERATORS index, and
+	// lists are gathered on a scratch stack and copied into Ast::extra once
+	// complete, so the tree arrays only ever grow at the end. The first
+	// error stops the parse.
+	class Parser {
+	public:
+		// Nested blocks and expressions. The deepest nesting takes about
+		// 256 KiB of stack, so it fits the 1 MiB default of Windows threads
+		// with room for larger debug frames.
+		static constexpr size_t MAX_DEPTH = 500;
+
+		NONE_OR_TRACEBACK parse(const TokenBuffer& tokens, Ast& ast) {
+			this->tokens = &tokens;
+			this->ast = &ast;
+			types = tokens.types.data();
+			values = tokens.values.data();
+			offsets = tokens.offsets.data();
+			lengths = tokens.lengths.data();
+			source = tokens.source.data();
+			pos = 0;
+			depth = 0;
+			failed = false;
+			scratch.clear();
+			operators.clear();
+			ast.clear();
+			ast.nodes.reserve(tokens.size() + 1);
+			ast.extra.reserve(tokens.size() + 1);
+
+			if (tokens.empty() || types[tokens.size() - 1] != TokenType::END_OF_FILE)
+				throw invalid_argument("Parser: the token stream does not end with END_OF_FILE");
+			while (types[pos] != TokenType::END_OF_FILE && statement()) {}
+			if (failed)
+				return NONE_OR_TRACEBACK(error, TRACEBACK_ERROR);
+			ast.root = list(NodeKind::Program, 0, 0);
+			return NONE_OR_TRACEBACK(0);
+		}
+
+	private:
+		static constexpr SymbolId IF = keywordId("IF"), WHILE = keywordId("WHILE"), FOR = keywordId("FOR"),
+			IMPORT = keywordId("IMPORT"), RETURN = keywordId("RETURN"), FUNCTION = keywordId("FUNCTION"),
+			ELSE = keywordId("ELSE"), BREAK = keywordId("BREAK"), CONTINUE = keywordId("CONTINUE"),
+			LIST = keywordId("LIST");
+		static constexpr size_t POWER = operatorIndex("**"), ASSIGN = operatorIndex("="),
+			PLUS = operatorIndex("+"), MINUS = operatorIndex("-");
+
+		const TokenBuffer* tokens = nullptr;
+		Ast* ast = nullptr;
+		const TokenType* types = nullptr;		// arrays of tokens
+		const uint32_t* values = nullptr;
+		const uint32_t* offsets = nullptr;
+		const uint32_t* lengths = nullptr;
+		const char* source = nullptr;
+		size_t pos = 0;
+		size_t depth = 0;
+		bool failed = false;
+		TRACEBACK error = {};
+		vector<NodeId> scratch;		// lists and operands being gathered, innermost on top
+		vector<size_t> operators;	// tokens of the binary operators waiting for their right operand
+
+		struct Nesting {
+			size_t& depth;
+			~Nesting() {
+				depth--;
+			}
+		};
+
+		TokenType type() const {
+			return types[pos];
+		}
+		bool atKeyword(SymbolId keyword) const {
+			return types[pos] == TokenType::Keyword && values[pos] == keyword;
+		}
+		bool at(char punctuator) const {
+			return types[pos] == TokenType::Punctuator && source[offsets[pos]] == punctuator;
+		}
+		bool atStatementEnd() const {
+			TokenType t = types[pos];
+			return t == TokenType::NEWLINE || t == TokenType::END_OF_FILE || t == TokenType::DEDENT || at(';');
+		}
+		size_t operatorAt(size_t index) const {
+			const char* text = source + offsets[index];
+			return OPERATOR_DFA.match(text, text + lengths[index]).op;
+		}
+
+		NodeId add(NodeKind kind, size_t token, NodeId lhs = NO_NODE, NodeId rhs = NO_NODE, size_t op = 0) {
+			ast->nodes.push_back({ kind, (uint8_t)op, (uint32_t)token, lhs, rhs });
+			return (NodeId)(ast->nodes.size() - 1);
+		}
+		// A node whose list is scratch from mark on
+		NodeId list(NodeKind kind, size_t token, size_t mark) {
+			NodeId start = (NodeId)ast->extra.size();
+			ast->extra.insert(ast->extra.end(), scratch.begin() + mark, scratch.end());
+			NodeId count = (NodeId)(scratch.size() - mark);
+			scratch.resize(mark);
+			return add(kind, token, start, count);
+		}
+
+		NodeId fail(const char* message, size_t token) {
+			if (!failed) {
+				failed = true;
+				error = { tokens->line(token), tokens->column(token), message };
+			}
+			return NO_NODE;
+		}
+		NodeId fail(const char* message) {
+			return fail(message, pos);
+		}
+		NodeId unexpected() {
+			switch (types[pos]) {
+			case TokenType::NEWLINE:
+				return fail("SyntaxError: unexpected end of line");
+			case TokenType::END_OF_FILE:
+				return fail("SyntaxError: unexpected end of file");
+			case TokenType::INDENT:
+				return fail("IndentationError: unexpected indent");
+			case TokenType::DEDENT:
+				return fail("IndentationError: unexpected end of block");
+			default:
+				return fail("SyntaxError: unexpected token");
+			}
+		}
+		bool expect(char punctuator, const char* message) {
+			if (at(punctuator)) {
+				pos++;
+				return true;
+			}
+			fail(message);
+			return false;
+		}
+		bool deeper() {
+			if (++depth <= MAX_DEPTH)
+				return true;
+			fail("RecursionError: blocks or expressions nested too deeply");
+			return false;
+		}
+
+		// Statements
+
+		// One line's worth: a compound statement, or simple ones split by ';'.
+		// Their nodes go to scratch.
+		bool statement() {
+			if (types[pos] == TokenType::Keyword) {
+				NodeId node;
+				switch (values[pos]) {
+				case IF:
+					node = ifStatement();
+					break;
+				case WHILE:
+					node = whileStatement();
+					break;
+				case FOR:
+					node = forStatement();
+					break;
+				case FUNCTION:
+					node = function();
+					break;
+				default:
+					return simpleLine();
+				}
+				if (failed)
+					return false;
+				scratch.push_back(node);
+				return true;
+			}
+			if (types[pos] == TokenType::NEWLINE) {
+				pos++;
+				return true;
+			}
+			return simpleLine();
+		}
+		bool simpleLine() {
+			for (;;) {
+				NodeId node = simpleStatement();
+				if (failed)
+					return false;
+				scratch.push_back(node);
+				if (!at(';'))
+					break;
+				pos++;
+				if (atStatementEnd())
+					break;
+			}
+			if (types[pos] == TokenType::NEWLINE)
+				pos++;
+			else if (types[pos] != TokenType::END_OF_FILE) {
+				unexpected();
+				return false;
+			}
+			return true;
+		}
+		NodeId simpleStatement() {
+			size_t start = pos;
+			if (types[pos] == TokenType::Keyword) {
+				switch (values[pos]) {
+				case RETURN: {
+					pos++;
+					NodeId value = NO_NODE;
+					if (!atStatementEnd()) {
+						value = expression();
+						if (failed)
+							return NO_NODE;
+					}
+					return add(NodeKind::Return, start, value);
+				}
+				case BREAK:
+					pos++;
+					return add(NodeKind::Break, start);
+				case CONTINUE:
+					pos++;
+					return add(NodeKind::Continue, start);
+				case IMPORT:
+					return importStatement();
+				case ELSE:
+					return fail("SyntaxError: ELSE without IF");
+				default:
+					return unexpected();
+				}
+			}
+			if (types[pos] == TokenType::Type && !(types[pos + 1] == TokenType::Punctuator
+				&& source[offsets[pos + 1]] == '('))
+				return declaration();
+			return assignment();
+		}
+		NodeId declaration() {
+			NodeId type = typeName();
+			if (failed)
+				return NO_NODE;
+			if (types[pos] != TokenType::Identifier)
+				return fail("SyntaxError: expected a name after the type");
+			size_t name = pos++;
+			NodeId value = NO_NODE;
+			if (types[pos] == TokenType::Assignment) {
+				if (operatorAt(pos) != ASSIGN)
+					return fail("SyntaxError: a declaration is initialized with '='");
+				pos++;
+				value = expression();
+				if (failed)
+					return NO_NODE;
+			}
+			return add(NodeKind::Declaration, name, type, value);
+		}
+		NodeId typeName() {
+			size_t token = pos++;
+			NodeId element = NO_NODE;
+			if (values[token] == LIST && at('[')) {
+				pos++;
+				if (types[pos] != TokenType::Type)
+					return fail("SyntaxError: expected the element type of the LIST");
+				element = typeName();
+				if (failed || !expect(']', "SyntaxError: expected ']' after the element type"))
+					return NO_NODE;
+			}
+			return add(NodeKind::TypeName, token, element);
+		}
+		// An expression, assigned to when an assignment operator follows
+		NodeId assignment() {
+			NodeId target = expression();
+			if (failed || types[pos] != TokenType::Assignment)
+				return target;
+			NodeKind kind = ast->nodes[target].kind;
+			if (kind != NodeKind::Name && kind != NodeKind::Index && kind != NodeKind::Member)
+				return fail("SyntaxError: cannot assign to expression");
+			size_t token = pos++;
+			NodeId value = expression();
+			if (failed)
+				return NO_NODE;
+			return add(NodeKind::Assign, token, target, value, operatorAt(token));
+		}
+		NodeId importStatement() {
+			size_t start = pos++;
+			size_t mark = scratch.size();
+			for (;;) {
+				if (types[pos] != TokenType::Identifier)
+					return fail("SyntaxError: expected a module name");
+				scratch.push_back(add(NodeKind::Name, pos++));
+				if (!at('.'))
+					break;
+				pos++;
+			}
+			return list(NodeKind::Import, start, mark);
+		}
+
+		// ':' and the statements of the indented block after it, or the
+		// simple statements after it on the same line
+		NodeId block() {
+			if (!at(':'))
+				return fail("SyntaxError: expected ':'");
+			size_t colon = pos++;
+			if (!deeper())
+				return NO_NODE;
+			Nesting nesting{ depth };
+			size_t mark = scratch.size();
+			if (types[pos] == TokenType::NEWLINE) {
+				pos++;
+				if (types[pos] != TokenType::INDENT)
+					return fail("IndentationError: expected an indented block");
+				pos++;
+				while (types[pos] != TokenType::DEDENT && types[pos] != TokenType::END_OF_FILE)
+					if (!statement())
+						return NO_NODE;
+				if (types[pos] == TokenType::DEDENT)
+					pos++;
+			}
+			else if (!simpleLine())
+				return NO_NODE;
+			return list(NodeKind::Block, colon, mark);
+		}
+		// IF and its ELSE IF links are parsed in a loop, a condition and body
+		// per link on scratch, and the If nodes are built from the last link
+		// back, so a chain of any length takes no stack
+		NodeId ifStatement() {
+			size_t mark = scratch.size();
+			NodeId otherwise = NO_NODE;
+			for (;;) {
+				size_t start = pos++;
+				NodeId condition = expression();
+				if (failed)
+					return NO_NODE;
+				NodeId body = block();
+				if (failed)
+					return NO_NODE;
+				scratch.push_back((NodeId)start);
+				scratch.push_back(condition);
+				scratch.push_back(body);
+				if (!atKeyword(ELSE))
+					break;
+				pos++;
+				if (!atKeyword(IF)) {
+					otherwise = block();
+					if (failed)
+						return NO_NODE;
+					break;
+				}
+			}
+			for (size_t link = scratch.size(); link > mark; link -= 3) {
+				NodeId record = (NodeId)ast->extra.size();
+				ast->extra.push_back(scratch[link - 1]);
+				ast->extra.push_back(otherwise);
+				otherwise = add(NodeKind::If, scratch[link - 3], scratch[link - 2], record);
+			}
+			scratch.resize(mark);
+			return otherwise;
+		}
+		NodeId whileStatement() {
+			size_t start = pos++;
+			NodeId condition = expression();
+			if (failed)
+				return NO_NODE;
+			NodeId body = block();
+			if (failed)
+				return NO_NODE;
+			return add(NodeKind::While, start, condition, body);
+		}
+		// FOR init; condition; step: with any of the three left out
+		NodeId forStatement() {
+			size_t start = pos++;
+			NodeId init = NO_NODE, condition = NO_NODE, step = NO_NODE;
+			if (!at(';')) {
+				init = simpleStatement();
+				if (failed)
+					return NO_NODE;
+			}
+			if (!expect(';', "SyntaxError: expected ';' after the FOR initializer"))
+				return NO_NODE;
+			if (!at(';')) {
+				condition = expression();
+				if (failed)
+					return NO_NODE;
+			}
+			if (!expect(';', "SyntaxError: expected ';' after the FOR condition"))
+				return NO_NODE;
+			if (!at(':')) {
+				step = assignment();
+				if (failed)
+					return NO_NODE;
+			}
+			NodeId body = block();
+			if (failed)
+				return NO_NODE;
+			NodeId record = (NodeId)ast->extra.size();
+			ast->extra.push_back(init);
+			ast->extra.push_back(condition);
+			ast->extra.push_back(step);
+			return add(NodeKind::For, start, record, body);
+		}
+		// FUNCTION name(Type name, ...) -> Type: with the return type optional
+		NodeId function() {
+			pos++;
+			if (types[pos] != TokenType::Identifier)
+				return fail("SyntaxError: expected a function name");
+			size_t name = pos++;
+			if (!expect('(', "SyntaxError: expected '(' after the function name"))
+				return NO_NODE;
+			size_t mark = scratch.size();
+			while (!at(')')) {
+				if (types[pos] != TokenType::Type)
+					return fail("SyntaxError: expected the type of a parameter");
+				NodeId type = typeName();
+				if (failed)
+					return NO_NODE;
+				if (types[pos] != TokenType::Identifier)
+					return fail("SyntaxError: expected a parameter name");
+				scratch.push_back(add(NodeKind::Parameter, pos++, type));
+				if (!at(','))
+					break;
+				pos++;
+			}
+			if (!expect(')', "SyntaxError: expected ')' after the parameters"))
+				return NO_NODE;
+			NodeId result = NO_NODE;
+			if (types[pos] == TokenType::Follow) {
+				pos++;
+				if (types[pos] != TokenType::Type)
+					return fail("SyntaxError: expected the return type after '->'");
+				result = typeName();
+				if (failed)
+					return NO_NODE;
+			}
+			NodeId body = block();
+			if (failed)
+				return NO_NODE;
+			NodeId record = (NodeId)ast->extra.size();
+			ast->extra.push_back(result);
+			ast->extra.push_back(body);
+			ast->extra.insert(ast->extra.end(), scratch.begin() + mark, scratch.end());
+			NodeId count = (NodeId)(scratch.size() - mark);
+			scratch.resize(mark);
+			return add(NodeKind::Function, name, record, count);
+		}
+
+		// Expressions
+
+		// Operator precedence over the levels of BINARY_PRECEDENCE, all left
+		// associative. Operands wait on scratch and operators on operators
+		// until one binding no tighter follows, so the stack depth does not
+		// grow with the number of levels.
+		NodeId expression() {
+			size_t operator_mark = operators.size();
+			NodeId operand = unary();
+			if (failed)
+				return NO_NODE;
+			scratch.push_back(operand);
+			while (types[pos] == TokenType::Operator) {
+				uint8_t level = BINARY_PRECEDENCE.level[operatorAt(pos)];
+				if (level == 0)
+					break;
+				reduce(operator_mark, level);
+				operators.push_back(pos++);
+				operand = unary();
+				if (failed)
+					return NO_NODE;
+				scratch.push_back(operand);
+			}
+			reduce(operator_mark, 1);
+			operand = scratch.back();
+			scratch.pop_back();
+			return operand;
+		}
+		// Applies the waiting operators of level min_level or above
+		void reduce(size_t operator_mark, uint8_t min_level) {
+			while (operators.size() > operator_mark) {
+				size_t token = operators.back();
+				size_t op = operatorAt(token);
+				if (BINARY_PRECEDENCE.level[op] < min_level)
+					break;
+				operators.pop_back();
+				NodeId rhs = scratch.back();
+				scratch.pop_back();
+				scratch.back() = add(NodeKind::Binary, token, scratch.back(), rhs, op);
+			}
+		}
+		NodeId unary() {
+			if (!deeper())
+				return NO_NODE;
+			Nesting nesting{ depth };
+			if (types[pos] == TokenType::Operator) {
+				size_t op = operatorAt(pos);
+				if (op != PLUS && op != MINUS)
+					return unexpected();
+				size_t token = pos++;
+				NodeId operand = unary();
+				if (failed)
+					return NO_NODE;
+				return add(NodeKind::Unary, token, operand, NO_NODE, op);
+			}
+			NodeId base = postfix();
+			if (failed || types[pos] != TokenType::Operator || operatorAt(pos) != POWER)
+				return base;
+			size_t token = pos++;
+			NodeId exponent = unary();
+			if (failed)
+				return NO_NODE;
+			return add(NodeKind::Binary, token, base, exponent, POWER);
+		}
+		NodeId postfix() {
+			NodeId node = primary();
+			while (!failed && types[pos] == TokenType::Punctuator) {
+				size_t token = pos;
+				if (at('(')) {
+					pos++;
+					size_t mark = scratch.size();
+					scratch.push_back(node);
+					if (!items(')', "SyntaxError: expected ')' after the arguments"))
+						return NO_NODE;
+					NodeId start = (NodeId)ast->extra.size();
+					ast->extra.insert(ast->extra.end(), scratch.begin() + mark, scratch.end());
+					NodeId count = (NodeId)(scratch.size() - mark - 1);
+					scratch.resize(mark);
+					node = add(NodeKind::Call, token, start, count);
+				}
+				else if (at('[')) {
+					pos++;
+					NodeId index = expression();
+					if (failed || !expect(']', "SyntaxError: expected ']' after the index"))
+						return NO_NODE;
+					node = add(NodeKind::Index, token, node, index);
+				}
+				else if (at('.')) {
+					pos++;
+					if (types[pos] != TokenType::Identifier)
+						return fail("SyntaxError: expected a name after '.'");
+					node = add(NodeKind::Member, pos++, node);
+				}
+				else
+					break;
+			}
+			return failed ? NO_NODE : node;
+		}
+		// Comma separated expressions up to close, a trailing comma allowed;
+		// pushed to scratch
+		bool items(char close, const char* message) {
+			while (!at(close)) {
+				NodeId item = expression();
+				if (failed)
+					return false;
+				scratch.push_back(item);
+				if (!at(','))
+					break;
+				pos++;
+			}
+			return expect(close, message);
+		}
+		NodeId primary() {
+			size_t token = pos;
+			switch (types[pos]) {
+			case TokenType::Identifier:
+				pos++;
+				return add(NodeKind::Name, token);
+			case TokenType::LiteralNumber:
+				pos++;
+				return add(NodeKind::Integer, token);
+			case TokenType::LiteralFloat:
+				pos++;
+				return add(NodeKind::Float, token);
+			case TokenType::LiteralString:
+				pos++;
+				return add(NodeKind::String, token);
+			case TokenType::LiteralChar:
+				pos++;
+				return add(NodeKind::Char, token);
+			case TokenType::LiteralBool:
+				pos++;
+				return add(NodeKind::Bool, token);
+			case TokenType::Type: {
+				// a conversion: the type is called like a function
+				NodeId type = typeName();
+				if (!failed && !at('('))
+					return fail("SyntaxError: expected '(' after the type");
+				return type;
+			}
+			case TokenType::Punctuator:
+				if (at('(')) {
+					pos++;
+					NodeId inner = expression();
+					if (failed || !expect(')', "SyntaxError: expected ')'"))
+						return NO_NODE;
+					return inner;
+				}
+				if (at('[')) {
+					pos++;
+					size_t mark = scratch.size();
+					if (!items(']', "SyntaxError: expected ']' after the list items"))
+						return NO_NODE;
+					return list(NodeKind::List, token, mark);
+				}
+				return unexpected();
+			default:
+				return unexpected();
+			}
+		}
+	};
+
+	// Parses tokens, a whole source tokenized into a TokenBuffer, into ast.
+	// The tree refers to tokens by index, so they go together.
+	inline NONE_OR_TRACEBACK parse(const TokenBuffer& tokens, Ast& ast) {
+		Parser parser;
+		return parser.parse(tokens, ast);
+	}
+
+	// Tokenizes source into tokens and parses them into ast
+	inline NONE_OR_TRACEBACK parse(string_view source, TokenBuffer& tokens, Ast& ast, SymbolTable* symbols = nullptr) {
+		NONE_OR_TRACEBACK res = tokenize(source, tokens, symbols);
+		if (res.is_traceback)
+			return res;
+		return parse(tokens, ast);
+	}
+}
+
+using _pyrope::Ast, _pyrope::AstNode, _pyrope::NodeId, _pyrope::NodeKind, _pyrope::Parser, _pyrope::parse;
@@ -0,0 +1,303 @@
+﻿/*
+* Copyright 2025 github.com/PD758
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*      http://www.apache.org/licenses/LICENSE-2.0
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define PYROPE_SCAN_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PYROPE_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define PYROPE_TARGET_AVX2
+#endif
+
+using namespace std;
+
+namespace _pyrope {
+	// ASCII character classes used by the lexer. Unlike isspace/isalpha
+	// they do not depend on the locale and are defined for bytes >= 0x80
+	// (which belong to no class, as in the "C" locale).
+	enum CharClass : uint8_t {
+		CHAR_SPACE = 1,		// ' ' \t \n \v \f \r
+		CHAR_ALPHA = 2,		// A-Z a-z
+		CHAR_DIGIT = 4,		// 0-9
+		CHAR_IDENT = 8,		// A-Z a-z 0-9 _
+	};
+
+	struct CharClasses {
+		uint8_t flags[256];
+		constexpr CharClasses() : flags() {
+			for (int c = 0; c < 256; c++) {
+				uint8_t f = 0;
+				if (c == ' ' || (c >= '\t' && c <= '\r'))
+					f |= CHAR_SPACE;
+				if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z'))
+					f |= CHAR_ALPHA | CHAR_IDENT;
+				if (c >= '0' && c <= '9')
+					f |= CHAR_DIGIT | CHAR_IDENT;
+				if (c == '_')
+					f |= CHAR_IDENT;
+				flags[c] = f;
+			}
+		}
+		constexpr bool is(char c, uint8_t mask) const {
+			return (flags[(unsigned char)c] & mask) != 0;
+		}
+	};
+	inline constexpr CharClasses CHAR_CLASSES{};
+
+	// Scan kernels: each returns the first byte in [p, end) that does not
+	// continue the run, or end. All kernel sets must give identical results.
+	struct ScalarScan {
+		// indentation: ' ' only
+		static const char* spaces(const char* p, const char* end) {
+			while (p < end && *p == ' ')
+				p++;
+			return p;
+		}
+		// comment body: up to '\n'
+		static const char* newline(const char* p, const char* end) {
+			const void* found = memchr(p, '\n', (size_t)(end - p));
+			return found ? (const char*)found : end;
+		}
+		static const char* identifier(const char* p, const char* end) {
+			while (p < end && CHAR_CLASSES.is(*p, CHAR_IDENT))
+				p++;
+			return p;
+		}
+		static const char* digits(const char* p, const char* end) {
+			while (p < end && CHAR_CLASSES.is(*p, CHAR_DIGIT))
+				p++;
+			return p;
+		}
+		// string literal body: up to '"', '\\' or '\n'
+		static const char* stringBody(const char* p, const char* end) {
+			while (p < end && *p != '"' && *p != '\\' && *p != '\n')
+				p++;
+			return p;
+		}
+	};
+
+#ifdef PYROPE_SCAN_X86
+	inline uint32_t firstSetBit(uint32_t mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return (uint32_t)index;
+#else
+		return (uint32_t)__builtin_ctz(mask);
+#endif
+	}
+
+	// 16 bytes per step. Ranges are tested with signed compares, so bytes
+	// >= 0x80 are negative and fall outside every class.
+	struct Sse2Scan {
+		static __m128i identMask(__m128i v) {
+			__m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+			__m128i alpha = _mm_and_si128(
+				_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+				_mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+			__m128i digit = _mm_and_si128(
+				_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+				_mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+			__m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+			return _mm_or_si128(_mm_or_si128(alpha, digit), under);
+		}
+		static __m128i digitMask(__m128i v) {
+			return _mm_and_si128(
+				_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+				_mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+		}
+
+		static const char* spaces(const char* p, const char* end) {
+			for (; end - p >= 16; p += 16) {
+				__m128i v = _mm_loadu_si128((const __m128i*)p);
+				uint32_t stop = ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(' '))) & 0xFFFF;
+				if (stop)
+					return p + firstSetBit(stop);
+			}
+			return ScalarScan::spaces(p, end);
+		}
+		static const char* newline(const char* p, const char* end) {
+			for (; end - p >= 16; p += 16) {
+				__m128i v = _mm_loadu_si128((const __m128i*)p);
+				uint32_t stop = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+				if (stop)
+					return p + firstSetBit(stop);
+			}
+			return ScalarScan::newline(p, end);
+		}
+		static const char* identifier(const char* p, const char* end) {
+			for (; end - p >= 16; p += 16) {
+				__m128i v = _mm_loadu_si128((const __m128i*)p);
+				uint32_t stop = ~(uint32_t)_mm_movemask_epi8(identMask(v)) & 0xFFFF;
+				if (stop)
+					return p + firstSetBit(stop);
+			}
+			return ScalarScan::identifier(p, end);
+		}
+		static const char* digits(const char* p, const char* end) {
+			for (; end - p >= 16; p += 16) {
+				__m128i v = _mm_loadu_si128((const __m128i*)p);
+				uint32_t stop = ~(uint32_t)_mm_movemask_epi8(digitMask(v)) & 0xFFFF;
+				if (stop)
+					return p + firstSetBit(stop);
+			}
+			return ScalarScan::digits(p, end);
+		}
+		static const char* stringBody(const char* p, const char* end) {
+			for (; end - p >= 16; p += 16) {
+				__m128i v = _mm_loadu_si128((const __m128i*)p);
+				__m128i hit = _mm_or_si128(_mm_or_si128(
+					_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+					_mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))),
+					_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+				uint32_t stop = (uint32_t)_mm_movemask_epi8(hit);
+				if (stop)
+					return p + firstSetBit(stop);
+			}
+			return ScalarScan::stringBody(p, end);
+		}
+	};
+
+	// 32 bytes per step, the tail goes through the SSE2 kernels
+	struct Avx2Scan {
+		PYROPE_TARGET_AVX2 static __m256i identMask(__m256i v) {
+			__m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+			__m256i alpha = _mm256_and_si256(
+				_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+				_mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+			__m256i digit = _mm256_and_si256(
+				_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+				_mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+			__m256i under = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+			return _mm256_or_si256(_mm256_or_si256(alpha, digit), under);
+		}
+
+		PYROPE_TARGET_AVX2 static const char* spaces(const char* p, const char* end) {
+			for (; end - p >= 32; p += 32) {
+				__m256i v = _mm256_loadu_si256((const __m256i*)p);
+				uint32_t stop = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+				if (stop)
+					return p + firstSetBit(stop);
+			}
+			return Sse2Scan::spaces(p, end);
+		}
+		PYROPE_TARGET_AVX2 static const char* newline(const char* p, const char* end) {
+			for (; end - p >= 32; p += 32) {
+				__m256i v = _mm256_loadu_si256((const __m256i*)p);
+				uint32_t stop = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+				if (stop)
+					return p + firstSetBit(stop);
+			}
+			return Sse2Scan::newline(p, end);
+		}
+		PYROPE_TARGET_AVX2 static const char* identifier(const char* p, const char* end) {
+			for (; end - p >= 32; p += 32) {
+				__m256i v = _mm256_loadu_si256((const __m256i*)p);
+				uint32_t stop = ~(uint32_t)_mm256_movemask_epi8(identMask(v));
+				if (stop)
+					return p + firstSetBit(stop);
+			}
+			return Sse2Scan::identifier(p, end);
+		}
+		PYROPE_TARGET_AVX2 static const char* digits(const char* p, const char* end) {
+			for (; end - p >= 32; p += 32) {
+				__m256i v = _mm256_loadu_si256((const __m256i*)p);
+				__m256i digit = _mm256_and_si256(
+					_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+					_mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+				uint32_t stop = ~(uint32_t)_mm256_movemask_epi8(digit);
+				if (stop)
+					return p + firstSetBit(stop);
+			}
+			return Sse2Scan::digits(p, end);
+		}
+		PYROPE_TARGET_AVX2 static const char* stringBody(const char* p, const char* end) {
+			for (; end - p >= 32; p += 32) {
+				__m256i v = _mm256_loadu_si256((const __m256i*)p);
+				__m256i hit = _mm256_or_si256(_mm256_or_si256(
+					_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')),
+					_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))),
+					_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+				uint32_t stop = (uint32_t)_mm256_movemask_epi8(hit);
+				if (stop)
+					return p + firstSetBit(stop);
+			}
+			return Sse2Scan::stringBody(p, end);
+		}
+	};
+#endif
+
+	enum class ScanLevel {
+		Scalar,
+		SSE2,
+		AVX2,
+	};
+
+	// Best kernel set this CPU can run
+	inline ScanLevel supportedScanLevel() {
+#ifdef PYROPE_SCAN_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] >= 7) {
+			__cpuid(info, 1);
+			bool osxsave = (info[2] & (1 << 27)) != 0;
+			bool avx = (info[2] & (1 << 28)) != 0;
+			// the OS must save the ymm registers
+			if (osxsave && avx && (_xgetbv(0) & 6) == 6) {
+				__cpuidex(info, 7, 0);
+				if (info[1] & (1 << 5))
+					return ScanLevel::AVX2;
+			}
+		}
+#else
+		if (__builtin_cpu_supports("avx2"))
+			return ScanLevel::AVX2;
+#endif
+		return ScanLevel::SSE2;
+#else
+		return ScanLevel::Scalar;
+#endif
+	}
+
+	// Kernel set the tokenizers dispatch on, read once per call. Atomic, as
+	// it may be set while other threads are lexing.
+	inline atomic<ScanLevel>& activeScanLevel() {
+		static atomic<ScanLevel> level{ supportedScanLevel() };
+		return level;
+	}
+
+	// Forces a kernel set (clamped to what the CPU supports), e.g. to
+	// compare the vector kernels against the scalar ones
+	inline ScanLevel setScanLevel(ScanLevel level) {
+		ScanLevel supported = supportedScanLevel();
+		ScanLevel chosen = level > supported ? supported : level;
+		activeScanLevel().store(chosen, memory_order_relaxed);
+		return chosen;
+	}
+}
+
+using _pyrope::ScanLevel, _pyrope::setScanLevel;
@@ -0,0 +1,220 @@
+﻿/*
+* Copyright 2025 github.com/PD758
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*      http://www.apache.org/licenses/LICENSE-2.0
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "test.hpp"
+#include "../allocator.hpp"
+
+// Multi-threaded stress of the allocator. Worth running in a build with
+// -DPYROPE_SANITIZE=thread as well as address.
+
+// Whether every byte of memory is tag
+static bool filledWith(const RawMemory& memory, uint8_t tag) {
+	for (size_t i = 0; i < memory.size; i++)
+		if (((const uint8_t*)memory.cdata())[i] != tag)
+			return false;
+	return true;
+}
+
+static bool aligned(const RawMemory& memory) {
+	return (uintptr_t)memory.cdata() % RawMemory::PAYLOAD_ALIGNMENT == 0;
+}
+
+// Inline, slab and large payloads, grown, shrunk and unshared
+TEST("allocator/payload_alignment") {
+	for (size_t size = 0; size <= SLAB_MAX_BLOCK + 64; size += size < 256 ? 1 : 37) {
+		RawMemory value(size);
+		CHECK(aligned(value));
+		RawMemory copy = value;
+		copy.fill(1);
+		CHECK(aligned(copy));
+		value.realloc_(size * 3 + 1);
+		CHECK(aligned(value));
+		value.realloc_(size / 2);
+		CHECK(aligned(value));
+	}
+}
+
+// An entry dropping to zero again and again before a collector looks at it
+// is queued once, and again after the collector has been
+TEST("allocator/release_queue") {
+	for (bool concurrent : { false, true }) {
+		Allocator allocator(concurrent);
+		MemoryHandle handle = allocator.alloc(64, 1);
+		allocator.release(handle);
+		for (int i = 0; i < 1000; i++) {
+			allocator.retain(handle);
+			allocator.release(handle);
+		}
+		CHECK(allocator.gcPending() == 1);
+		allocator.retain(handle);
+		CHECK(allocator.gcStep(16) == 0);
+		allocator.release(handle);
+		allocator.release(handle);
+		CHECK(allocator.gcPending() == 1);
+		CHECK(allocator.gcStep(16) == 1);
+		CHECK(allocator.gcPending() == 0);
+		MemoryHandle reused = allocator.alloc(64, 1);
+		allocator.release(reused);
+		CHECK(allocator.gcPending() == 1);
+		allocator.gc();
+		CHECK(allocator.gcPending() == 0);
+	}
+}
+
+// Threads sharing a concurrent allocator: each keeps values of its own
+// filled with its tag, checks them before release and hands some to the
+// other threads, while a collector runs incremental and full collections
+TEST("allocator/concurrent_pool") {
+	const size_t workers = 4;
+	Allocator allocator(true);
+	mutex exchange_lock;
+	vector<MemoryHandle> exchange;
+	atomic<size_t> running = workers;
+	atomic<size_t> corrupted = 0;
+	vector<thread> threads;
+	for (size_t w = 0; w < workers; w++)
+		threads.emplace_back([&, w] {
+			mt19937 rng((unsigned)w);
+			uint8_t tag = (uint8_t)(w + 1);
+			vector<MemoryHandle> held;
+			for (int i = 0; i < 20000; i++) {
+				MemoryHandle handle = allocator.alloc(rng() % 200, 1);
+				allocator.get(handle).fill(tag);
+				held.push_back(handle);
+				if (held.size() > 64 || rng() % 3 == 0) {
+					size_t victim = rng() % held.size();
+					if (!filledWith(allocator.get(held[victim]), tag))
+						corrupted++;
+					if (rng() % 8 == 0) {
+						lock_guard<mutex> hold(exchange_lock);
+						exchange.push_back(held[victim]);
+					}
+					else
+						allocator.release(held[victim]);
+					held[victim] = held.back();
+					held.pop_back();
+				}
+				if (rng() % 16 == 0) {
+					lock_guard<mutex> hold(exchange_lock);
+					if (!exchange.empty()) {
+						allocator.release(exchange.back());
+						exchange.pop_back();
+					}
+				}
+			}
+			for (MemoryHandle handle : held) {
+				if (!filledWith(allocator.get(handle), tag))
+					corrupted++;
+				allocator.release(handle);
+			}
+			running--;
+		});
+	threads.emplace_back([&] {
+		for (size_t round = 0; running > 0; round++)
+			if (round % 64 == 63)
+				allocator.gc();
+			else
+				allocator.gcStep(128);
+	});
+	for (thread& t : threads)
+		t.join();
+	for (MemoryHandle handle : exchange)
+		allocator.release(handle);
+	allocator.gc();
+	CHECK(corrupted == 0);
+	CHECK(allocator.free_count == allocator.size());
+}
+
+// Values of every size class made on one thread and freed, copied and
+// written on another, so blocks move between the thread caches through
+// SlabCentral and shared blocks lose owners on several threads at once.
+// Threads end in the middle, giving their cached blocks back.
+TEST("allocator/slab_across_threads") {
+	const size_t workers = 4;
+	struct Parcel {
+		RawMemory value;
+		uint8_t tag;
+	};
+	mutex lock;
+	vector<Parcel> parcels;
+	atomic<size_t> corrupted = 0;
+	for (int generation = 0; generation < 3; generation++) {
+		vector<thread> threads;
+		for (size_t w = 0; w < workers; w++)
+			threads.emplace_back([&, w] {
+				mt19937 rng((unsigned)(generation * workers + w));
+				vector<Parcel> mine;
+				for (int i = 0; i < 20000; i++) {
+					size_t size = rng() % 32 == 0 ? SLAB_MAX_BLOCK + rng() % 4096 : rng() % 600;
+					uint8_t tag = (uint8_t)rng();
+					mine.push_back({ RawMemory(size), tag });
+					mine.back().value.fill(tag);
+					if (rng() % 2 == 0) {
+						Parcel parcel = move(mine.back());
+						mine.pop_back();
+						lock_guard<mutex> hold(lock);
+						parcels.push_back(move(parcel));
+					}
+					if (rng() % 2 == 0) {
+						Parcel parcel;
+						{
+							lock_guard<mutex> hold(lock);
+							if (parcels.empty())
+								continue;
+							size_t pick = rng() % parcels.size();
+							parcel = move(parcels[pick]);
+							parcels[pick] = move(parcels.back());
+							parcels.pop_back();
+						}
+						if (!filledWith(parcel.value, parcel.tag))
+							corrupted++;
+						if (rng() % 2 == 0) {
+							// a copy sharing the block goes back for another thread
+							Parcel copy{ parcel.value, parcel.tag };
+							lock_guard<mutex> hold(lock);
+							parcels.push_back(move(copy));
+						}
+						if (rng() % 2 == 0) {
+							// written while possibly shared
+							parcel.tag ^= 0x5a;
+							parcel.value.fill(parcel.tag);
+							mine.push_back(move(parcel));
+						}
+					}
+					if (mine.size() > 256) {
+						if (!filledWith(mine.front().value, mine.front().tag))
+							corrupted++;
+						mine.front() = move(mine.back());
+						mine.pop_back();
+					}
+				}
+				for (const Parcel& parcel : mine)
+					if (!filledWith(parcel.value, parcel.tag))
+						corrupted++;
+			});
+		for (thread& t : threads)
+			t.join();
+	}
+	for (const Parcel& parcel : parcels)
+		if (!filledWith(parcel.value, parcel.tag))
+			corrupted++;
+	CHECK(corrupted == 0);
+}
@@ -0,0 +1,93 @@
+﻿/*
+* Copyright 2025 github.com/PD758
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*      http://www.apache.org/licenses/LICENSE-2.0
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#pragma once
+
+#include <random>
+#include <string>
+
+#include "test.hpp"
+#include "../incremental_tokenizer.hpp"
+
+// Nested blocks of assignments with numbers, strings with and without
+// escapes and comments, at least bytes long
+static string editTestSource(mt19937& rng, size_t bytes) {
+	const char* names[] = { "value", "x", "INT32", "IF", "buffer_index", "RETURN" };
+	const char* literals[] = { "42", "3.25", "0x1F", "\"plain text\"", "\"tab\\tquote\\\"\"", "'c'" };
+	string out;
+	size_t depth = 0;
+	while (out.size() < bytes) {
+		out.append(depth * 4, ' ');
+		out += names[rng() % 6];
+		out += " = ";
+		out += literals[rng() % 6];
+		out += rng() % 3 == 0 ? " # note\n" : "\n";
+		if (depth < 5 && rng() % 4 == 0) {
+			out.append(depth * 4, ' ');
+			out += "IF x:\n";
+			depth++;
+		}
+		else if (depth > 0 && rng() % 4 == 0)
+			depth--;
+	}
+	return out;
+}
+
+// Random edits, the damaging ones included, each checked against a full
+// re-lex of the edited source
+static void checkRetokenizeAgrees(unsigned seed, bool with_symbols) {
+	const char* pieces[] = { "", "\n", "    ", "'", "\"", "#", "x", "\t", "IF a:\n", "\n    y = 1\n", "\\", "\\t\"" };
+	mt19937 rng(seed);
+	string source = editTestSource(rng, 16 * 1024);
+	SymbolTable symbols;
+	SymbolTable* table = with_symbols ? &symbols : nullptr;
+	TokenBuffer tokens, full;
+	tokenize(source, tokens, table);
+	for (int i = 0; i < 500; i++) {
+		TextEdit edit;
+		edit.offset = i % 50 == 0 ? source.size() : rng() % (source.size() + 1);
+		edit.removed = min<size_t>(source.size() - edit.offset, rng() % 4);
+		string inserted = rng() % 2 ? pieces[rng() % 12] : source.substr(rng() % source.size(), rng() % 40);
+		edit.inserted = inserted;
+		string removed = source.substr(edit.offset, edit.removed);
+		applyEdit(source, edit);
+		NONE_OR_TRACEBACK res = retokenize(tokens, source, edit, table);
+		NONE_OR_TRACEBACK expected = tokenize(source, full, table);
+		bool same = tokens.types == full.types && tokens.offsets == full.offsets && tokens.lengths == full.lengths
+			&& tokens.values == full.values && tokens.line_starts == full.line_starts
+			&& tokens.numbers == full.numbers && tokens.texts == full.texts
+			&& res.is_traceback == expected.is_traceback
+			&& (!res.is_traceback || (res.error.line == expected.error.line && res.error.column == expected.error.column));
+		if (!CHECK(same)) {
+			fprintf(stderr, "  seed %u, edit %d: %zu bytes at %zu replaced by %s\n", seed, i,
+				edit.removed, edit.offset, test::quoted(inserted).c_str());
+			return;
+		}
+		if (res.is_traceback) {
+			// take it back, so that most edits start from a complete stream
+			TextEdit undo{ edit.offset, inserted.size(), removed };
+			applyEdit(source, undo);
+			tokenize(source, tokens, table);
+		}
+	}
+}
+
+TEST("incremental/random_edits") {
+	for (unsigned seed : { 7u, 8u, 9u })
+		checkRetokenizeAgrees(seed, false);
+}
+
+TEST("incremental/random_edits_with_symbols") {
+	for (unsigned seed : { 7u, 8u, 9u })
+		checkRetokenizeAgrees(seed, true);
+}
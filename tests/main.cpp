@@ -0,0 +1,51 @@
+﻿/*
+* Copyright 2025 github.com/PD758
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*      http://www.apache.org/licenses/LICENSE-2.0
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+// Test suite. Like the benchmarks it is a single translation unit, built by
+// CMakeLists.txt, which registers every group of cases with ctest, or by hand:
+//     g++ -std=c++17 -O1 -pthread -o pyrope_tests tests/main.cpp
+// Usage: pyrope_tests [filter] - runs the cases whose name contains filter.
+// Exits with 1 if a check failed or no case matched.
+#include <exception>
+
+#include "test.hpp"
+#include "allocator.hpp"
+#include "incremental.hpp"
+#include "scan.hpp"
+
+int main(int argc, char** argv) {
+	const char* filter = argc > 1 ? argv[1] : "";
+	size_t run = 0, failed = 0;
+	for (const test::Case& c : test::registry()) {
+		if (c.name.find(filter) == string::npos)
+			continue;
+		size_t before = test::failures();
+		try {
+			c.body();
+		}
+		catch (const exception& e) {
+			test::failures()++;
+			fprintf(stderr, "%s: exception: %s\n", c.name.c_str(), e.what());
+		}
+		bool ok = test::failures() == before;
+		printf("%s %s\n", ok ? "ok  " : "FAIL", c.name.c_str());
+		run++;
+		failed += ok ? 0 : 1;
+	}
+	if (run == 0) {
+		fprintf(stderr, "no test case matches \"%s\"\n", filter);
+		return 1;
+	}
+	printf("%zu of %zu cases failed\n", failed, run);
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,196 @@
+﻿/*
+* Copyright 2025 github.com/PD758
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*      http://www.apache.org/licenses/LICENSE-2.0
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#pragma once
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "test.hpp"
+#include "../tokenizer.hpp"
+
+// Differential tests of the scan kernels: every kernel set must stop where
+// the scalar one does. Inputs are copied to buffers of exactly their size,
+// so a sanitizer build also catches reads past the end of the source.
+
+// Run lengths around the 16 and 32 byte strides of the vector kernels
+static const size_t SCAN_RUN_LENGTHS[] = { 0, 1, 2, 14, 15, 16, 17, 30, 31, 32, 33, 34, 47, 48, 49, 63, 64, 65, 96 };
+
+// The vector kernel sets this CPU runs
+static vector<ScanLevel> vectorScanLevels() {
+	vector<ScanLevel> levels;
+	for (ScanLevel level : { ScanLevel::SSE2, ScanLevel::AVX2 })
+		if (level <= _pyrope::supportedScanLevel())
+			levels.push_back(level);
+	return levels;
+}
+
+// text in a heap block of its exact size
+struct ExactBuffer {
+	unique_ptr<char[]> bytes;
+	size_t size;
+
+	explicit ExactBuffer(string_view text) : bytes(new char[text.size() > 0 ? text.size() : 1]), size(text.size()) {
+		memcpy(bytes.get(), text.data(), text.size());
+	}
+	string_view view() const {
+		return string_view(bytes.get(), size);
+	}
+};
+
+typedef const char* (*ScanKernel)(const char* p, const char* end);
+
+struct ScanKernels {
+	const char* name;
+	ScanKernel spaces, newline, identifier, digits, stringBody;
+};
+
+template<typename Scan>
+static ScanKernels kernelsOf(const char* name) {
+	return { name, &Scan::spaces, &Scan::newline, &Scan::identifier, &Scan::digits, &Scan::stringBody };
+}
+
+TEST("scan/kernels") {
+	vector<ScanKernels> sets;
+#ifdef PYROPE_SCAN_X86
+	for (ScanLevel level : vectorScanLevels())
+		sets.push_back(level == ScanLevel::AVX2 ? kernelsOf<_pyrope::Avx2Scan>("avx2") : kernelsOf<_pyrope::Sse2Scan>("sse2"));
+#endif
+	ScanKernels scalar = kernelsOf<_pyrope::ScalarScan>("scalar");
+	// bytes that continue the run of each kernel, cycled through
+	struct Run {
+		const char* kernel;
+		ScanKernel ScanKernels::* member;
+		string_view bytes;
+	};
+	const Run runs[] = {
+		{ "spaces", &ScanKernels::spaces, " " },
+		{ "newline", &ScanKernels::newline, string_view("a #\"\\\t\r\x80\xff", 9) },
+		{ "identifier", &ScanKernels::identifier, "aZ_9q" },
+		{ "digits", &ScanKernels::digits, "0189" },
+		{ "stringBody", &ScanKernels::stringBody, string_view("a #'\t\x80\xc3\xa9", 8) },
+	};
+	// what stops a run; an empty one is the end of the buffer
+	const string_view stops[] = { "", "\n", "\"", "\\", " ", "a", "0", "_", "#", "\t", "\r",
+		string_view("\0", 1), "\x7f", "\x80", "\xff" };
+
+	for (const Run& run : runs)
+		for (size_t length : SCAN_RUN_LENGTHS)
+			for (size_t offset = 0; offset < 34; offset++)
+				for (string_view stop : stops) {
+					string text(offset, '\n');
+					for (size_t i = 0; i < length; i++)
+						text += run.bytes[i % run.bytes.size()];
+					text += stop;
+					ExactBuffer buffer(text);
+					const char* begin = buffer.bytes.get() + offset;
+					const char* end = buffer.bytes.get() + buffer.size;
+					const char* expected = (scalar.*run.member)(begin, end);
+					for (const ScanKernels& set : sets) {
+						const char* found = (set.*run.member)(begin, end);
+						if (!CHECK(found == expected))
+							fprintf(stderr, "  %s %s on %s from %zu: %td, scalar %td\n", set.name, run.kernel,
+								test::quoted(text).c_str(), offset, found - begin, expected - begin);
+					}
+				}
+}
+
+// Token streams of source lexed at level and by the scalar kernels agree,
+// tracebacks included
+static void checkTokenizeAgrees(string_view source, ScanLevel level) {
+	ExactBuffer buffer(source);
+	TokenBuffer expected, found;
+	setScanLevel(ScanLevel::Scalar);
+	NONE_OR_TRACEBACK expected_res = tokenize(buffer.view(), expected);
+	setScanLevel(level);
+	NONE_OR_TRACEBACK found_res = tokenize(buffer.view(), found);
+	bool same = found.types == expected.types && found.offsets == expected.offsets
+		&& found.lengths == expected.lengths && found.values == expected.values
+		&& found.line_starts == expected.line_starts && found.texts == expected.texts
+		&& found.numbers.size() == expected.numbers.size()
+		&& found_res.is_traceback == expected_res.is_traceback;
+	for (size_t i = 0; same && i < found.numbers.size(); i++)
+		same = found.numbers[i].kind == expected.numbers[i].kind && found.numbers[i].integer == expected.numbers[i].integer
+			&& found.numbers[i].int_bits == expected.numbers[i].int_bits
+			&& found.numbers[i].uint_bits == expected.numbers[i].uint_bits;
+	if (same && found_res.is_traceback)
+		same = found_res.error.line == expected_res.error.line && found_res.error.column == expected_res.error.column
+			&& found_res.error.message == expected_res.error.message;
+	if (!CHECK(same))
+		fprintf(stderr, "  scan level %d on %s\n", (int)level, test::quoted(source).c_str());
+}
+
+// Each kind of token at every length and alignment, ended by a newline
+// or by the end of the buffer
+static vector<string> scanRunSources() {
+	vector<string> sources = {
+		"s = \"tab\\tnew\\nquote\\\"back\\\\hex\\x41\\x7e end\"\n",
+		"u = USTRING(\"\\u00e9\\u65e5 and \\\\u\")\n",
+		"c = 'q' + '\\n' + '\\''\n",
+		"t = \"caf\xc3\xa9 \xe6\x97\xa5\xe6\x9c\xac\" # \xc3\xa9t\xc3\xa9\n",
+		"IF a:\n    x = 1\n    # end of the block\n# top level\ny = 2\n",
+		"IF a:\n    x = 1\n    #",
+		"IF a:\n    x = 1 # trailing\n\n        # deeper comment\nz = 3",
+		"x = 1\r\ny = 2\r\n",
+		"x = \"unterminated\n",
+		"x = \"escape at the end\\",
+		"\xff\xfe = 1\n",
+	};
+	for (size_t length : SCAN_RUN_LENGTHS) {
+		if (length == 0)
+			continue;
+		string word(length, 'n'), digits(length, '7'), body(length, 'b'), spaces(length, ' ');
+		for (size_t i = 0; i < length; i += 5)
+			body[i] = ' ';
+		string escaped = body;
+		escaped[length - 1] = '\\';
+		escaped += 't';
+		vector<string> runs = {
+			word,
+			digits,
+			"\"" + body + "\"",
+			"\"" + escaped + "\"",
+			"x # " + body,
+			"x" + spaces + "+ y",
+		};
+		for (size_t pad = 0; pad < 33; pad++) {
+			string prefix = "x" + string(pad, ' ') + "= ";
+			for (const string& run : runs) {
+				sources.push_back(prefix + run);
+				sources.push_back(prefix + run + "\n");
+			}
+			sources.push_back("IF a:\n" + string(pad + 1, ' ') + word);
+		}
+	}
+	return sources;
+}
+
+TEST("scan/tokenize") {
+	ScanLevel active = _pyrope::activeScanLevel();
+	vector<string> sources = scanRunSources();
+	// and random mixes of the bytes the kernels stop at
+	mt19937 rng(2025);
+	const string_view alphabet("aZ_09 \n\"\\#'.+=(\t\x80\xc3\xa9", 20);
+	for (int i = 0; i < 3000; i++) {
+		string source(rng() % 120, ' ');
+		for (char& c : source)
+			c = alphabet[rng() % alphabet.size()];
+		sources.push_back(source);
+	}
+	for (ScanLevel level : vectorScanLevels())
+		for (const string& source : sources)
+			checkTokenizeAgrees(source, level);
+	setScanLevel(active);
+}
@@ -0,0 +1,84 @@
+﻿/*
+* Copyright 2025 github.com/PD758
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*      http://www.apache.org/licenses/LICENSE-2.0
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#pragma once
+
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Minimal test harness: a case runs its body once, CHECK reports a false
+// condition with its place and lets the case go on.
+namespace test {
+	struct Case {
+		string name;
+		function<void()> body;
+	};
+
+	inline vector<Case>& registry() {
+		static vector<Case> cases;
+		return cases;
+	}
+
+	struct Register {
+		Register(const char* name, function<void()> body) {
+			registry().push_back({ name, move(body) });
+		}
+	};
+
+	// Failed checks so far, over every case
+	inline size_t& failures() {
+		static size_t count = 0;
+		return count;
+	}
+
+	inline bool check(bool ok, const char* condition, const char* file, int line) {
+		if (!ok) {
+			failures()++;
+			fprintf(stderr, "%s:%d: check failed: %s\n", file, line, condition);
+		}
+		return ok;
+	}
+
+	// source with the bytes that would garble a report escaped
+	inline string quoted(string_view source) {
+		string out = "\"";
+		for (char c : source) {
+			if (c == '\n')
+				out += "\\n";
+			else if (c == '"' || c == '\\')
+				(out += '\\') += c;
+			else if ((unsigned char)c < 0x20 || (unsigned char)c >= 0x7f) {
+				char hex[8];
+				snprintf(hex, sizeof(hex), "\\x%02x", (unsigned char)c);
+				out += hex;
+			}
+			else
+				out += c;
+		}
+		return out + '"';
+	}
+}
+
+#define TEST_CONCAT_(a, b) a##b
+#define TEST_CONCAT(a, b) TEST_CONCAT_(a, b)
+// __COUNTER__ rather than __LINE__: every test header shares one translation unit
+#define TEST_(name, id) \
+	static void TEST_CONCAT(test_fn_, id)(); \
+	static test::Register TEST_CONCAT(test_reg_, id)(name, TEST_CONCAT(test_fn_, id)); \
+	static void TEST_CONCAT(test_fn_, id)()
+#define TEST(name) TEST_(name, __COUNTER__)
+#define CHECK(condition) test::check((condition), #condition, __FILE__, __LINE__)
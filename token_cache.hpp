@@ -0,0 +1,440 @@
+﻿/*
+* Copyright 2025 github.com/PD758
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+*  You may obtain a copy of the License at
+*      http://www.apache.org/licenses/LICENSE-2.0
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "tokenizer.hpp"
+
+using namespace std;
+
+namespace _pyrope {
+	// XXH64 of data, reading words in native byte order
+	inline uint64_t hashBytes(string_view data, uint64_t seed = 0) {
+		constexpr uint64_t P1 = 11400714785074694791ULL, P2 = 14029467366897019727ULL,
+			P3 = 1609587929392839161ULL, P4 = 9650029242287828579ULL, P5 = 2870177450012600261ULL;
+		auto rotl = [](uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+		auto round = [&](uint64_t acc, uint64_t input) { return rotl(acc + input * P2, 31) * P1; };
+		auto read64 = [](const char* p) { uint64_t v; memcpy(&v, p, 8); return v; };
+		auto read32 = [](const char* p) { uint32_t v; memcpy(&v, p, 4); return v; };
+
+		const char* p = data.data();
+		const char* const end = p + data.size();
+		uint64_t h;
+		if (data.size() >= 32) {
+			uint64_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+			for (; end - p >= 32; p += 32) {
+				v1 = round(v1, read64(p));
+				v2 = round(v2, read64(p + 8));
+				v3 = round(v3, read64(p + 16));
+				v4 = round(v4, read64(p + 24));
+			}
+			h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+			for (uint64_t v : { v1, v2, v3, v4 })
+				h = (h ^ round(0, v)) * P1 + P4;
+		}
+		else
+			h = seed + P5;
+		h += data.size();
+		for (; end - p >= 8; p += 8)
+			h = rotl(h ^ round(0, read64(p)), 27) * P1 + P4;
+		if (end - p >= 4) {
+			h = rotl(h ^ (read32(p) * P1), 23) * P2 + P3;
+			p += 4;
+		}
+		for (; p < end; p++)
+			h = rotl(h ^ ((unsigned char)*p * P5), 11) * P1;
+		h ^= h >> 33;
+		h *= P2;
+		h ^= h >> 29;
+		h *= P3;
+		h ^= h >> 32;
+		return h;
+	}
+
+	// Token cache file: this header, then the TokenBuffer arrays exactly as
+	// they are in memory, each section 8-byte aligned, so a mapping of the
+	// file is used in place. Fixed-width fields rather than varints keep every
+	// token at a known address. The file is only read back on the machine
+	// (byte order) and format version that wrote it, and only when the hash
+	// of everything after the header matches, so a torn file is a miss.
+	struct TokenCacheHeader {
+		char magic[8];
+		uint32_t version;
+		uint32_t byte_order;
+		uint64_t file_size;
+		uint64_t source_size;
+		uint64_t source_hash;
+		uint32_t token_count;
+		uint32_t line_count;
+		uint32_t name_count;
+		uint32_t name_bytes;
+		uint32_t number_count;
+		uint32_t text_count;
+		uint32_t text_bytes;
+		uint32_t reserved;
+		uint64_t body_hash;			// hashBytes of the file after the header
+		uint64_t types_at;			// TokenType[token_count]
+		uint64_t offsets_at;		// uint32_t[token_count]
+		uint64_t lengths_at;		// uint32_t[token_count]
+		uint64_t values_at;			// uint32_t[token_count], names as KEYWORD_COUNT + name index
+		uint64_t numbers_at;		// NumberValue[number_count]
+		uint64_t lines_at;			// uint32_t[line_count]
+		uint64_t names_at;			// uint32_t[name_count + 1], name bounds in the characters
+		uint64_t chars_at;			// char[name_bytes]
+		uint64_t texts_at;			// uint32_t[text_count + 1], decoded string bounds in the text characters
+		uint64_t text_chars_at;		// char[text_bytes]
+	};
+	static_assert(sizeof(TokenCacheHeader) == 160, "TokenCacheHeader must have no padding");
+
+	inline constexpr char TOKEN_CACHE_MAGIC[8] = { 'P', 'Y', 'R', 'T', 'O', 'K', 'C', '\0' };
+	static_assert(sizeof(NumberValue) == 16, "NumberValue is stored as is");
+	inline constexpr uint32_t TOKEN_CACHE_VERSION = 4;
+	inline constexpr uint32_t TOKEN_CACHE_BYTE_ORDER = 0x01020304;
+
+	// A token cache file mapped read-only. open() checks the header against
+	// the source and the rest of the file against its hash, then the tokens
+	// and lines against the source size, and returns false on a missing,
+	// stale or damaged file.
+	// The hash catches torn and short files, the checks files that were
+	// written wrong.
+	class CachedTokens {
+	public:
+		bool open(const string& path, uint64_t source_hash, size_t source_size) {
+			header = nullptr;
+			try {
+				file.open(path);
+			}
+			catch (const runtime_error&) {
+				return false;
+			}
+			if (file.size() < sizeof(TokenCacheHeader))
+				return false;
+			const TokenCacheHeader* h = (const TokenCacheHeader*)file.data();
+			if (memcmp(h->magic, TOKEN_CACHE_MAGIC, 8) != 0 || h->version != TOKEN_CACHE_VERSION
+				|| h->byte_order != TOKEN_CACHE_BYTE_ORDER || h->file_size != file.size()
+				|| h->source_size != source_size || h->source_hash != source_hash)
+				return false;
+			if (hashBytes(string_view(file.data() + sizeof(TokenCacheHeader), file.size() - sizeof(TokenCacheHeader)))
+				!= h->body_hash)
+				return false;
+			if (!fits(h->types_at, h->token_count, 1) || !fits(h->offsets_at, h->token_count, 4)
+				|| !fits(h->lengths_at, h->token_count, 4) || !fits(h->values_at, h->token_count, 4)
+				|| !fits(h->numbers_at, h->number_count, sizeof(NumberValue))
+				|| !fits(h->lines_at, h->line_count, 4) || !fits(h->names_at, (uint64_t)h->name_count + 1, 4)
+				|| !fits(h->chars_at, h->name_bytes, 1) || !fits(h->texts_at, (uint64_t)h->text_count + 1, 4)
+				|| !fits(h->text_chars_at, h->text_bytes, 1) || h->line_count == 0)
+				return false;
+			if (!ordered(h->names_at, h->name_count, h->name_bytes) || !ordered(h->texts_at, h->text_count, h->text_bytes)
+				|| !consistent(h))
+				return false;
+			header = h;
+			return true;
+		}
+		void close() {
+			header = nullptr;
+			file.close();
+		}
+		bool isOpen() const {
+			return header != nullptr;
+		}
+
+		size_t size() const {
+			return header->token_count;
+		}
+		const TokenType* types() const {
+			return section<TokenType>(header->types_at);
+		}
+		const uint32_t* offsets() const {
+			return section<uint32_t>(header->offsets_at);
+		}
+		const uint32_t* lengths() const {
+			return section<uint32_t>(header->lengths_at);
+		}
+		const uint32_t* values() const {
+			return section<uint32_t>(header->values_at);
+		}
+		size_t numberCount() const {
+			return header->number_count;
+		}
+		const NumberValue* numbers() const {
+			return section<NumberValue>(header->numbers_at);
+		}
+		size_t lineCount() const {
+			return header->line_count;
+		}
+		const uint32_t* lineStarts() const {
+			return section<uint32_t>(header->lines_at);
+		}
+		size_t nameCount() const {
+			return header->name_count;
+		}
+		// Name of the symbol KEYWORD_COUNT + index in the values
+		string_view name(size_t index) const {
+			const uint32_t* bounds = section<uint32_t>(header->names_at);
+			return string_view(section<char>(header->chars_at) + bounds[index], bounds[index + 1] - bounds[index]);
+		}
+		size_t textCount() const {
+			return header->text_count;
+		}
+		// Decoded text of the string literals with the value index
+		string_view text(size_t index) const {
+			const uint32_t* bounds = section<uint32_t>(header->texts_at);
+			return string_view(section<char>(header->text_chars_at) + bounds[index], bounds[index + 1] - bounds[index]);
+		}
+
+		// Fills tokens as tokenize would have; names are interned into symbols,
+		// or left without an id when there is no table
+		bool copyTo(TokenBuffer& tokens, string_view source, SymbolTable* symbols) const {
+			vector<SymbolId> ids(nameCount(), NO_SYMBOL);
+			if (symbols != nullptr)
+				for (size_t i = 0; i < ids.size(); i++)
+					ids[i] = symbols->intern(name(i));
+			size_t count = size();
+			tokens.reset(source);
+			tokens.types.assign(types(), types() + count);
+			tokens.offsets.assign(offsets(), offsets() + count);
+			tokens.lengths.assign(lengths(), lengths() + count);
+			tokens.values.assign(values(), values() + count);
+			tokens.line_starts.assign(lineStarts(), lineStarts() + lineCount());
+			tokens.numbers.assign(numbers(), numbers() + numberCount());
+			tokens.texts.reserve(textCount());
+			for (size_t i = 0; i < textCount(); i++)
+				tokens.texts.push_back(tokens.strings.intern(text(i)));
+			for (size_t i = 0; i < count; i++) {
+				if ((isNumberLiteral(tokens.types[i]) && tokens.values[i] >= numberCount())
+					|| (tokens.types[i] == TokenType::LiteralString && tokens.values[i] != NO_SYMBOL
+						&& tokens.values[i] >= textCount())) {
+					tokens.reset(source);
+					return false;
+				}
+				if (tokens.types[i] != TokenType::Identifier)
+					continue;
+				size_t index = tokens.values[i] - (size_t)KEYWORD_COUNT;
+				if (index >= ids.size()) {
+					tokens.reset(source);
+					return false;
+				}
+				tokens.values[i] = ids[index];
+			}
+			return true;
+		}
+
+	private:
+		MappedFile file;
+		const TokenCacheHeader* header = nullptr;
+
+		template<typename T>
+		const T* section(uint64_t at) const {
+			return (const T*)(file.data() + at);
+		}
+		bool fits(uint64_t at, uint64_t count, uint64_t width) const {
+			return at % 8 == 0 && at >= sizeof(TokenCacheHeader) && at <= file.size()
+				&& count <= (file.size() - at) / width;
+		}
+		// Bounds at start cut bytes characters into count non-overlapping texts
+		bool ordered(uint64_t at, uint32_t count, uint32_t bytes) const {
+			const uint32_t* bounds = section<uint32_t>(at);
+			for (uint32_t i = 0; i < count; i++)
+				if (bounds[i] > bounds[i + 1])
+					return false;
+			return bounds[0] == 0 && bounds[count] == bytes;
+		}
+		// Every token a known type within the source, and the line starts
+		// ascending from 0 within it, so TokenBuffer never reads past either.
+		// A NEWLINE's length is that of its "\\n" lexeme, not of source text.
+		bool consistent(const TokenCacheHeader* h) const {
+			const TokenType* token_types = section<TokenType>(h->types_at);
+			const uint32_t* token_offsets = section<uint32_t>(h->offsets_at);
+			const uint32_t* token_lengths = section<uint32_t>(h->lengths_at);
+			for (uint32_t i = 0; i < h->token_count; i++) {
+				if (token_types[i] > TokenType::UNKNOWN)
+					return false;
+				uint64_t length = token_types[i] == TokenType::NEWLINE ? 0 : token_lengths[i];
+				if (token_offsets[i] + length > h->source_size)
+					return false;
+			}
+			const uint32_t* lines = section<uint32_t>(h->lines_at);
+			for (uint32_t i = 1; i < h->line_count; i++)
+				if (lines[i] < lines[i - 1])
+					return false;
+			return lines[0] == 0 && lines[h->line_count - 1] <= h->source_size;
+		}
+	};
+
+	// Packs texts into the bounds and characters layout of the cache file
+	inline void packTexts(const vector<string_view>& texts, vector<uint32_t>& bounds, string& chars) {
+		bounds.assign(1, 0);
+		chars.clear();
+		for (string_view text : texts) {
+			chars += text;
+			bounds.push_back((uint32_t)chars.size());
+		}
+	}
+
+	// Creates a file next to path that no other writer uses: its name has
+	// random bits in it and it must not exist yet. Returns null on failure.
+	inline FILE* createTemporary(const string& path, string& temporary) {
+		random_device random;
+		uint64_t seed = (uint64_t)chrono::steady_clock::now().time_since_epoch().count()
+			^ (uint64_t)hash<thread::id>()(this_thread::get_id());
+		for (int attempt = 0; attempt < 4; attempt++) {
+			uint64_t tag = hashBytes(string_view((const char*)&seed, sizeof(seed)), ((uint64_t)random() << 32) | random());
+			char suffix[32];
+			snprintf(suffix, sizeof(suffix), ".%016llx.tmp", (unsigned long long)tag);
+			temporary = path + suffix;
+			FILE* out = fopen(temporary.c_str(), "wbx");
+			if (out != nullptr)
+				return out;
+		}
+		return nullptr;
+	}
+
+	// Writes the cache file of tokens, a complete TokenBuffer of source.
+	// Names are numbered by first use, independently of the table the
+	// tokens were lexed with. The file is written to a temporary of its own
+	// and renamed into place, so readers never see half of it and writers
+	// missing at once do not mix their files. Returns false on I/O errors.
+	inline bool writeTokenCache(const string& path, string_view source, uint64_t source_hash,
+				const TokenBuffer& tokens) {
+		SymbolTable names;
+		vector<uint32_t> values = tokens.values;
+		for (size_t i = 0; i < tokens.size(); i++)
+			if (tokens.types[i] == TokenType::Identifier)
+				values[i] = names.intern(tokens.lexeme(i));
+		vector<string_view> spellings;
+		for (SymbolId id = KEYWORD_COUNT; id < names.size(); id++)
+			spellings.push_back(names.name(id));
+		vector<uint32_t> bounds, text_bounds;
+		string chars, text_chars;
+		packTexts(spellings, bounds, chars);
+		packTexts(tokens.texts, text_bounds, text_chars);
+
+		TokenCacheHeader header = {};
+		memcpy(header.magic, TOKEN_CACHE_MAGIC, 8);
+		header.version = TOKEN_CACHE_VERSION;
+		header.byte_order = TOKEN_CACHE_BYTE_ORDER;
+		header.source_size = source.size();
+		header.source_hash = source_hash;
+		header.token_count = (uint32_t)tokens.size();
+		header.line_count = (uint32_t)tokens.line_starts.size();
+		header.name_count = (uint32_t)(bounds.size() - 1);
+		header.name_bytes = (uint32_t)chars.size();
+		header.number_count = (uint32_t)tokens.numbers.size();
+		header.text_count = (uint32_t)tokens.texts.size();
+		header.text_bytes = (uint32_t)text_chars.size();
+		uint64_t at = sizeof(TokenCacheHeader);
+		auto place = [&](uint64_t bytes) {
+			uint64_t start = at;
+			at = (at + bytes + 7) / 8 * 8;
+			return start;
+		};
+		header.types_at = place(tokens.size());
+		header.offsets_at = place(tokens.size() * 4);
+		header.lengths_at = place(tokens.size() * 4);
+		header.values_at = place(tokens.size() * 4);
+		header.numbers_at = place(tokens.numbers.size() * sizeof(NumberValue));
+		header.lines_at = place(tokens.line_starts.size() * 4);
+		header.names_at = place(bounds.size() * 4);
+		header.chars_at = place(chars.size());
+		header.texts_at = place(text_bounds.size() * 4);
+		header.text_chars_at = place(text_chars.size());
+		header.file_size = at;
+
+		string file(sizeof(TokenCacheHeader), '\0');
+		file.reserve(at);
+		auto put = [&](const void* data, uint64_t bytes) {
+			if (bytes > 0)
+				file.append((const char*)data, bytes);
+			file.append((8 - file.size() % 8) % 8, '\0');
+		};
+		put(tokens.types.data(), tokens.size());
+		put(tokens.offsets.data(), tokens.size() * 4);
+		put(tokens.lengths.data(), tokens.size() * 4);
+		put(values.data(), values.size() * 4);
+		put(tokens.numbers.data(), tokens.numbers.size() * sizeof(NumberValue));
+		put(tokens.line_starts.data(), tokens.line_starts.size() * 4);
+		put(bounds.data(), bounds.size() * 4);
+		put(chars.data(), chars.size());
+		put(text_bounds.data(), text_bounds.size() * 4);
+		put(text_chars.data(), text_chars.size());
+		header.body_hash = hashBytes(string_view(file).substr(sizeof(TokenCacheHeader)));
+		memcpy(file.data(), &header, sizeof(header));
+
+		string temporary;
+		FILE* out = createTemporary(path, temporary);
+		if (out == nullptr)
+			return false;
+		size_t written = fwrite(file.data(), 1, file.size(), out);
+		bool ok = fclose(out) == 0 && written == header.file_size;
+		error_code error;
+		if (ok)
+			filesystem::rename(temporary, path, error);
+		if (!ok || error) {
+			remove(temporary.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	// Directory of token cache files named by the hash of their source
+	class TokenCache {
+	public:
+		explicit TokenCache(string directory) : directory(move(directory)) {}
+
+		string path(uint64_t source_hash) const {
+			char name[24];
+			snprintf(name, sizeof(name), "%016llx.ptc", (unsigned long long)source_hash);
+			return (filesystem::path(directory) / name).string();
+		}
+		bool load(string_view source, uint64_t source_hash, TokenBuffer& tokens, SymbolTable* symbols) const {
+			CachedTokens cached;
+			return cached.open(path(source_hash), source_hash, source.size())
+				&& cached.copyTo(tokens, source, symbols);
+		}
+		bool store(string_view source, uint64_t source_hash, const TokenBuffer& tokens) const {
+			error_code error;
+			filesystem::create_directories(directory, error);
+			return !error && writeTokenCache(path(source_hash), source, source_hash, tokens);
+		}
+
+	private:
+		string directory;
+	};
+
+	// tokenize through cache: on a hit the source is not lexed at all, on a
+	// miss it is and the tokens are stored. Only complete streams are cached,
+	// a traceback is lexed again every time.
+	inline NONE_OR_TRACEBACK tokenizeCached(string_view source, TokenBuffer& tokens,
+				const TokenCache& cache, SymbolTable* symbols = nullptr) {
+		uint64_t source_hash = hashBytes(source);
+		if (cache.load(source, source_hash, tokens, symbols))
+			return NONE_OR_TRACEBACK(0);
+		NONE_OR_TRACEBACK res = tokenize(source, tokens, symbols);
+		if (!res.is_traceback)
+			cache.store(source, source_hash, tokens);
+		return res;
+	}
+}
+
+using _pyrope::hashBytes, _pyrope::CachedTokens, _pyrope::TokenCache, _pyrope::tokenizeCached;
@@ -15,17 +15,29 @@
 
 #include <iostream>
 
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 #include <unordered_map>
-#include <stack>
+#include <unordered_set>
 
+#include "allocator.hpp"
+#include "scan.hpp"
 #include "traceback.hpp"
 
 using namespace std;
 
 namespace _pyrope {
-	enum class TokenType {
+	enum class TokenType : uint8_t {
 		Type,			// NONE, CHAR, UCHAR, INT{2,4,8,16,32}, UINT{2,4,8,16,32}, INT, UINT, FLOAT, DOUBLE, STRING, USTRING, LIST
 		Keyword,		// IF, WHILE, FOR, IMPORT, RETURN, FUNCTION, ELSE, BREAK, CONTINUE
 		Identifier,		// variable name, etc.
@@ -45,82 +57,886 @@ namespace _pyrope {
 		UNKNOWN,
 	};
 
+	// Interned name id; keywords and types own the first KEYWORD_COUNT ids
+	typedef uint32_t SymbolId;
+	inline constexpr SymbolId NO_SYMBOL = UINT32_MAX;
+
+	struct Keyword {
+		string_view text;
+		TokenType type;
+	};
+
+	inline constexpr Keyword KEYWORDS[] = {
+	// Types
+		{"NONE",	TokenType::Type},
+		{"CHAR",	TokenType::Type},
+		{"UCHAR",	TokenType::Type},
+		{"INT2",	TokenType::Type},
+		{"UINT2",	TokenType::Type},
+		{"INT4",	TokenType::Type},
+		{"UINT4",	TokenType::Type},
+		{"INT8",	TokenType::Type},
+		{"UINT8",	TokenType::Type},
+		{"INT16",	TokenType::Type},
+		{"UINT16",	TokenType::Type},
+		{"INT32",	TokenType::Type},
+		{"UINT32",	TokenType::Type},
+		{"INT",		TokenType::Type},
+		{"UINT",	TokenType::Type},
+		{"FLOAT",	TokenType::Type},
+		{"DOUBLE",	TokenType::Type},
+		{"STRING",	TokenType::Type},
+		{"USTRING",	TokenType::Type},
+		{"LIST",	TokenType::Type},
+	// Keywords
+		{"IF",		TokenType::Keyword},
+		{"WHILE",	TokenType::Keyword},
+		{"FOR",		TokenType::Keyword},
+		{"IMPORT",	TokenType::Keyword},
+		{"RETURN",	TokenType::Keyword},
+		{"FUNCTION",TokenType::Keyword},
+		{"ELSE",	TokenType::Keyword},
+		{"BREAK",	TokenType::Keyword},
+		{"CONTINUE",TokenType::Keyword},
+	// Literals
+		{"True",	TokenType::LiteralBool},
+		{"False",	TokenType::LiteralBool}
+	};
+	inline constexpr SymbolId KEYWORD_COUNT = sizeof(KEYWORDS) / sizeof(KEYWORDS[0]);
+
+	struct OperatorSpec {
+		string_view text;
+		TokenType type;
+	};
+
+	// Every operator, assignment and punctuator; OPERATOR_DFA is built from this list
+	inline constexpr OperatorSpec OPERATORS[] = {
+	// Operators
+		{"+",	TokenType::Operator},
+		{"-",	TokenType::Operator},
+		{"*",	TokenType::Operator},
+		{"/",	TokenType::Operator},
+		{"//",	TokenType::Operator},
+		{"%",	TokenType::Operator},
+		{"**",	TokenType::Operator},
+		{">",	TokenType::Operator},
+		{">=",	TokenType::Operator},
+		{"<",	TokenType::Operator},
+		{"<=",	TokenType::Operator},
+		{"|",	TokenType::Operator},
+		{"^",	TokenType::Operator},
+		{"&",	TokenType::Operator},
+		{"==",	TokenType::Operator},
+		{"!=",	TokenType::Operator},
+		{"||",	TokenType::Operator},
+		{"&&",	TokenType::Operator},
+	// Assignments
+		{"=",	TokenType::Assignment},
+		{"&=",	TokenType::Assignment},
+		{"+=",	TokenType::Assignment},
+		{"-=",	TokenType::Assignment},
+		{"*=",	TokenType::Assignment},
+		{"/=",	TokenType::Assignment},
+		{"%=",	TokenType::Assignment},
+		{"//=",	TokenType::Assignment},
+		{"**=",	TokenType::Assignment},
+	// Punctuators
+		{";",	TokenType::Punctuator},
+		{":",	TokenType::Punctuator},
+		{",",	TokenType::Punctuator},
+		{"[",	TokenType::Punctuator},
+		{"]",	TokenType::Punctuator},
+		{"(",	TokenType::Punctuator},
+		{")",	TokenType::Punctuator},
+		{".",	TokenType::Punctuator},
+	// Follow
+		{"->",	TokenType::Follow},
+	};
+	inline constexpr size_t OPERATOR_COUNT = sizeof(OPERATORS) / sizeof(OPERATORS[0]);
+
+	// Maximal-munch recognizer for OPERATORS, built at compile time.
+	// Bytes are mapped to character classes with one table load, states form
+	// a trie over the spec and each state remembers the operator it accepts.
+	struct OperatorDFA {
+		static constexpr size_t MAX_STATES = 128;
+		static constexpr size_t MAX_CLASSES = 64;
+		static constexpr uint8_t NO_STATE = 0;			// state 0 is the start state, never a target
+		static constexpr uint8_t NO_ACCEPT = 0xFF;
+
+		uint8_t classes[256] = {};						// 0: byte starts no operator
+		uint8_t next[MAX_STATES][MAX_CLASSES] = {};
+		uint8_t accept[MAX_STATES] = {};				// index into OPERATORS
+		size_t class_count = 1;
+		size_t state_count = 1;
+		bool overflow = false;
+
+		static constexpr OperatorDFA build() {
+			OperatorDFA dfa;
+			for (size_t i = 0; i < MAX_STATES; i++)
+				dfa.accept[i] = NO_ACCEPT;
+			for (size_t op = 0; op < OPERATOR_COUNT && !dfa.overflow; op++) {
+				uint8_t state = 0;
+				for (char c : OPERATORS[op].text) {
+					uint8_t& cls = dfa.classes[(unsigned char)c];
+					if (cls == 0) {
+						if (dfa.class_count == MAX_CLASSES) {
+							dfa.overflow = true;
+							break;
+						}
+						cls = (uint8_t)dfa.class_count++;
+					}
+					if (dfa.next[state][cls] == NO_STATE) {
+						if (dfa.state_count == MAX_STATES) {
+							dfa.overflow = true;
+							break;
+						}
+						dfa.next[state][cls] = (uint8_t)dfa.state_count++;
+					}
+					state = dfa.next[state][cls];
+				}
+				dfa.accept[state] = (uint8_t)op;
+			}
+			return dfa;
+		}
+
+		struct Match {
+			size_t length;		// 0 if no operator starts at p
+			size_t op;			// index into OPERATORS
+		};
+
+		// Longest operator at p
+		constexpr Match match(const char* p, const char* end) const {
+			Match m = { 0, 0 };
+			uint8_t state = 0;
+			for (size_t i = 0; p + i < end; i++) {
+				state = next[state][classes[(unsigned char)p[i]]];
+				if (state == NO_STATE)
+					break;
+				if (accept[state] != NO_ACCEPT)
+					m = { i + 1, accept[state] };
+			}
+			return m;
+		}
+	};
+	static_assert(OPERATOR_COUNT < OperatorDFA::NO_ACCEPT, "OPERATORS does not fit the operator DFA");
+	inline constexpr OperatorDFA OPERATOR_DFA = OperatorDFA::build();
+	static_assert(!OPERATOR_DFA.overflow, "OPERATORS needs more DFA states or character classes");
+
+	// Interned string storage on an Arena: text is copied once and equal
+	// texts share one copy. Views stay valid until clear(). The texts go to
+	// the arena given, or to the StringArena's own one, which always holds
+	// the lookup set. A given arena is shared, so clear() only forgets the
+	// texts, their memory returns when the owner of the arena resets it, and
+	// it must outlive the StringArena.
+	class StringArena {
+	public:
+		explicit StringArena(Arena* shared = nullptr)
+			: owned(new Arena()), arena(shared != nullptr ? shared : owned.get()),
+			interned(in_place, 0, hash<string_view>(), equal_to<string_view>(), ArenaAllocator<string_view>(*owned)) {}
+		StringArena(const StringArena&) = delete;
+		StringArena& operator=(const StringArena&) = delete;
+		// The texts move with their arena; the moved-from one starts over on
+		// a new arena of its own
+		StringArena(StringArena&& other) : StringArena() {
+			*this = move(other);
+		}
+		StringArena& operator=(StringArena&& other) {
+			if (this == &other)
+				return *this;
+			// the set's nodes live in the arena replaced below
+			interned.reset();
+			owned = move(other.owned);
+			arena = other.arena;
+			interned = move(other.interned);
+			other.interned.reset();
+			other.owned.reset(new Arena());
+			other.arena = other.owned.get();
+			other.interned.emplace(0, hash<string_view>(), equal_to<string_view>(), ArenaAllocator<string_view>(*other.owned));
+			return *this;
+		}
+
+		string_view store(string_view text) {
+			return arena->copy(text);
+		}
+		// store, but equal texts share one copy
+		string_view intern(string_view text) {
+			auto it = interned->find(text);
+			if (it != interned->end())
+				return *it;
+			string_view stored = store(text);
+			interned->insert(stored);
+			return stored;
+		}
+		// Forgets every text; the chunks are kept for reuse
+		void clear() {
+			interned.reset();
+			owned->reset();
+			interned = InternSet(0, hash<string_view>(), equal_to<string_view>(), ArenaAllocator<string_view>(*owned));
+		}
+
+	private:
+		typedef unordered_set<string_view, hash<string_view>, equal_to<string_view>, ArenaAllocator<string_view>> InternSet;
+
+		unique_ptr<Arena> owned;		// the lookup set, and the texts without a shared arena
+		Arena* arena;					// the texts
+		optional<InternSet> interned;	// destroyed before owned
+	};
+
+	// Maps every distinct name to a dense id. Names are copied once into
+	// chunked storage, so the table may outlive the sources it was filled from
+	// and can be shared between files and REPL iterations.
+	struct SymbolTable {
+		vector<string_view> names;
+		unordered_map<string_view, SymbolId> ids;
+		StringArena storage;
+
+		SymbolTable() {
+			names.reserve(KEYWORD_COUNT);
+			ids.reserve(KEYWORD_COUNT);
+			for (const Keyword& keyword : KEYWORDS) {
+				ids.emplace(keyword.text, (SymbolId)names.size());
+				names.push_back(keyword.text);
+			}
+		}
+		SymbolTable(const SymbolTable&) = delete;
+		SymbolTable& operator=(const SymbolTable&) = delete;
+
+		SymbolId intern(string_view name) {
+			auto it = ids.find(name);
+			if (it != ids.end())
+				return it->second;
+			if (names.size() >= NO_SYMBOL)
+				throw length_error("SymbolTable: too many symbols");
+			string_view stored = storage.store(name);
+			SymbolId id = (SymbolId)names.size();
+			names.push_back(stored);
+			ids.emplace(stored, id);
+			return id;
+		}
+		SymbolId find(string_view name) const {
+			auto it = ids.find(name);
+			return it != ids.end() ? it->second : NO_SYMBOL;
+		}
+		string_view name(SymbolId id) const {
+			return names[id];
+		}
+		size_t size() const {
+			return names.size();
+		}
+		static bool isKeyword(SymbolId id) {
+			return id < KEYWORD_COUNT;
+		}
+	};
+
+	enum class NumberKind : uint8_t {
+		None,
+		Integer,
+		Float,
+	};
+
+	// Value of a number literal, decoded once by the lexer. Literals are
+	// never negative (minus is an operator). int_bits and uint_bits give the
+	// narrowest of INT2..INT32 / UINT2..UINT32 holding the value, 64 when
+	// only INT / UINT do and 0 when INT does not; both are 0 for floats.
+	struct NumberValue {
+		union {
+			uint64_t integer;
+			double real;
+		};
+		NumberKind kind = NumberKind::None;
+		uint8_t int_bits = 0;
+		uint8_t uint_bits = 0;
+
+		NumberValue() : integer(0) {}
+
+		static NumberValue ofInteger(uint64_t integer) {
+			NumberValue value;
+			value.integer = integer;
+			value.kind = NumberKind::Integer;
+			for (uint8_t bits : { 2, 4, 8, 16, 32, 64 }) {
+				if (value.uint_bits == 0 && (bits == 64 || integer <= (uint64_t(1) << bits) - 1))
+					value.uint_bits = bits;
+				if (value.int_bits == 0 && integer <= (uint64_t(1) << (bits - 1)) - 1)
+					value.int_bits = bits;
+			}
+			return value;
+		}
+		static NumberValue ofFloat(double real) {
+			NumberValue value;
+			value.real = real;
+			value.kind = NumberKind::Float;
+			return value;
+		}
+
+		bool operator==(const NumberValue& other) const {
+			return kind == other.kind && integer == other.integer;
+		}
+		bool operator!=(const NumberValue& other) const {
+			return !(*this == other);
+		}
+	};
+
+	inline bool isNumberLiteral(TokenType type) {
+		return type == TokenType::LiteralNumber || type == TokenType::LiteralFloat;
+	}
+
 	struct Token {
 		TokenType type;
 		string lexeme;
 		size_t line = 1;
 		size_t column = 1;
+		SymbolId symbol = NO_SYMBOL;
+		NumberValue number;		// LiteralNumber and LiteralFloat
+	};
+
+	// Non-owning token: lexeme points into the source buffer (or into static
+	// storage for NEWLINE and decoded char literals), so the source must outlive it.
+	// A string literal with escapes points into the StringArena of the
+	// compilation it was lexed with.
+	struct TokenView {
+		TokenType type;
+		string_view lexeme;
+		size_t line = 1;
+		size_t column = 1;
+		SymbolId symbol = NO_SYMBOL;
+		NumberValue number;
+
+		Token owned() const {
+			return { type, string(lexeme), line, column, symbol, number };
+		}
+	};
+
+	// One byte per possible char value, so a decoded char literal
+	// can be referenced by a TokenView without allocating
+	struct CharLexemes {
+		char chars[256];
+		constexpr CharLexemes() : chars() {
+			for (int i = 0; i < 256; i++)
+				chars[i] = (char)i;
+		}
+		constexpr string_view operator[](char c) const {
+			return string_view(&chars[(unsigned char)c], 1);
+		}
 	};
+	inline constexpr CharLexemes CHAR_LEXEMES{};
 
 	inline void addToken(vector<Token>& tokens, TokenType type,
-				const string& lexeme, size_t line, size_t column) {
-		tokens.push_back({ type, lexeme, line, column });
-	}
-
-	TokenType handleKeyword(const string& lexeme) {
-		static const unordered_map<string, TokenType> keywords = {
-		// Types
-			{"NONE",	TokenType::Type},
-			{"CHAR",	TokenType::Type},
-			{"UCHAR",	TokenType::Type},
-			{"INT2",	TokenType::Type},
-			{"UINT2",	TokenType::Type},
-			{"INT4",	TokenType::Type},
-			{"UINT4",	TokenType::Type},
-			{"INT8",	TokenType::Type},
-			{"UINT8",	TokenType::Type},
-			{"INT16",	TokenType::Type},
-			{"UINT16",	TokenType::Type},
-			{"INT32",	TokenType::Type},
-			{"UINT32",	TokenType::Type},
-			{"INT",		TokenType::Type},
-			{"UINT",	TokenType::Type},
-			{"FLOAT",	TokenType::Type},
-			{"DOUBLE",	TokenType::Type},
-			{"STRING",	TokenType::Type},
-			{"USTRING",	TokenType::Type},
-			{"LIST",	TokenType::Type},
-		// Keywords
-			{"IF",		TokenType::Keyword},
-			{"WHILE",	TokenType::Keyword},
-			{"FOR",		TokenType::Keyword},
-			{"IMPORT",	TokenType::Keyword},
-			{"RETURN",	TokenType::Keyword},
-			{"FUNCTION",TokenType::Keyword},
-			{"ELSE",	TokenType::Keyword},
-			{"BREAK",	TokenType::Keyword},
-			{"CONTINUE",TokenType::Keyword},
-		// Literals
-			{"True",	TokenType::LiteralBool},
-			{"False",	TokenType::LiteralBool}
-		};
-		auto it = keywords.find(lexeme);
-		if (it != keywords.end())
-			return it->second;
+				string_view lexeme, size_t line, size_t column, SymbolId symbol = NO_SYMBOL) {
+		tokens.push_back({ type, string(lexeme), line, column, symbol, NumberValue() });
+	}
+	inline void addToken(vector<TokenView>& tokens, TokenType type,
+				string_view lexeme, size_t line, size_t column, SymbolId symbol = NO_SYMBOL) {
+		tokens.push_back({ type, lexeme, line, column, symbol, NumberValue() });
+	}
+	// Token vectors store line and column themselves
+	template<typename TokenT>
+	inline void addLine(vector<TokenT>&, size_t) {}
+
+	// Structure-of-arrays token storage, 13 bytes per token plus 4 per line,
+	// 16 per number literal and the decoded text of string literals with escapes.
+	// Only the position of a token is stored; line and column are found by
+	// binary search over the line starts recorded by the lexer, and the lexeme
+	// is a view into source (which must outlive the buffer).
+	struct TokenBuffer {
+		string_view source;
+		vector<TokenType> types;
+		vector<uint32_t> offsets;		// source offset that column refers to
+		vector<uint32_t> lengths;		// lexeme length
+		vector<uint32_t> values;		// SymbolId of names, byte of LiteralChar, width of INDENT, index in numbers or texts
+		vector<uint32_t> line_starts;	// line_starts[line - 1], as the lexer counted it
+		vector<NumberValue> numbers;	// values of the number literals, in source order
+		vector<string_view> texts;		// decoded string literals with escapes, in source order
+		StringArena strings;			// storage of texts
+
+		TokenBuffer() {}
+		// Decoded texts go to arena, which the caller resets between
+		// compilations and which must outlive the buffer
+		explicit TokenBuffer(Arena& arena) : strings(&arena) {}
+
+		size_t size() const {
+			return types.size();
+		}
+		bool empty() const {
+			return types.empty();
+		}
+		void reserve(size_t count) {
+			types.reserve(count);
+			offsets.reserve(count);
+			lengths.reserve(count);
+			values.reserve(count);
+		}
+		// Prepares the buffer for the tokens of a new source
+		void reset(string_view new_source) {
+			if (new_source.size() > UINT32_MAX)
+				throw length_error("TokenBuffer: source larger than 4 GiB");
+			source = new_source;
+			types.clear();
+			offsets.clear();
+			lengths.clear();
+			values.clear();
+			line_starts.assign(1, 0);
+			numbers.clear();
+			texts.clear();
+			strings.clear();
+		}
+		void push(TokenType type, size_t offset, size_t length, uint32_t value) {
+			types.push_back(type);
+			offsets.push_back((uint32_t)offset);
+			lengths.push_back((uint32_t)length);
+			values.push_back(value);
+		}
+
+		size_t line(size_t index) const {
+			// the last line starting at or before the token; empty lines may
+			// share a start with the next line, which is the one holding tokens
+			auto it = upper_bound(line_starts.begin(), line_starts.end(), offsets[index]);
+			return (size_t)(it - line_starts.begin());
+		}
+		size_t column(size_t index) const {
+			return offsets[index] - line_starts[line(index) - 1] + 1;
+		}
+		string_view lexeme(size_t index) const {
+			switch (types[index]) {
+			case TokenType::NEWLINE:
+				return "\\n";
+			case TokenType::LiteralChar:
+				return CHAR_LEXEMES[(char)values[index]];
+			case TokenType::LiteralString:
+				if (values[index] != NO_SYMBOL)
+					return texts[values[index]];
+				break;
+			default:
+				break;
+			}
+			// string and char literals (and their errors) start after the quote
+			size_t start = offsets[index];
+			if (lengths[index] > 0 && (source[start] == '"' || source[start] == '\''))
+				start++;
+			return source.substr(start, lengths[index]);
+		}
+		SymbolId symbol(size_t index) const {
+			switch (types[index]) {
+			case TokenType::LiteralChar:
+			case TokenType::INDENT:
+			case TokenType::LiteralNumber:
+			case TokenType::LiteralFloat:
+			case TokenType::LiteralString:
+				return NO_SYMBOL;
+			default:
+				return values[index];
+			}
+		}
+		NumberValue number(size_t index) const {
+			if (isNumberLiteral(types[index]))
+				return numbers[values[index]];
+			return NumberValue();
+		}
+		TokenView view(size_t index) const {
+			return { types[index], lexeme(index), line(index), column(index), symbol(index), number(index) };
+		}
+		Token token(size_t index) const {
+			return view(index).owned();
+		}
+	};
+
+	inline void addToken(TokenBuffer& tokens, TokenType type,
+				string_view lexeme, size_t line, size_t column, SymbolId symbol = NO_SYMBOL) {
+		size_t offset = tokens.line_starts[line - 1] + column - 1;
+		if (type == TokenType::LiteralChar)
+			tokens.push(type, offset, 1, (unsigned char)lexeme[0]);
+		else
+			tokens.push(type, offset, lexeme.size(), symbol);
+	}
+	inline void addLine(TokenBuffer& tokens, size_t line_start) {
+		tokens.line_starts.push_back((uint32_t)line_start);
+	}
+
+	// INDENT of a line indented by width: a TokenBuffer keeps the width,
+	// so the indent stack can be rebuilt from the tokens alone
+	template<typename TokenT>
+	inline void addIndent(vector<TokenT>& tokens, size_t line, size_t column, size_t) {
+		addToken(tokens, TokenType::INDENT, "", line, column);
+	}
+	inline void addIndent(TokenBuffer& tokens, size_t line, size_t column, size_t width) {
+		tokens.push(TokenType::INDENT, tokens.line_starts[line - 1] + column - 1, 0, (uint32_t)width);
+	}
+
+	// Number literal with its decoded value
+	template<typename TokenT>
+	inline void addNumber(vector<TokenT>& tokens, TokenType type,
+				string_view lexeme, size_t line, size_t column, const NumberValue& number) {
+		addToken(tokens, type, lexeme, line, column);
+		tokens.back().number = number;
+	}
+	inline void addNumber(TokenBuffer& tokens, TokenType type,
+				string_view lexeme, size_t line, size_t column, const NumberValue& number) {
+		tokens.push(type, tokens.line_starts[line - 1] + column - 1, lexeme.size(), (uint32_t)tokens.numbers.size());
+		tokens.numbers.push_back(number);
+	}
+
+	// String literal with escapes: raw is the source between the quotes,
+	// text its decoded value, copied to where the tokens keep it
+	inline void addString(vector<Token>& tokens, string_view, string_view text,
+				size_t line, size_t column, StringArena*) {
+		addToken(tokens, TokenType::LiteralString, text, line, column);
+	}
+	inline void addString(vector<TokenView>& tokens, string_view, string_view text,
+				size_t line, size_t column, StringArena* strings) {
+		addToken(tokens, TokenType::LiteralString, strings->intern(text), line, column);
+	}
+	inline void addString(TokenBuffer& tokens, string_view raw, string_view text,
+				size_t line, size_t column, StringArena*) {
+		tokens.push(TokenType::LiteralString, tokens.line_starts[line - 1] + column - 1, raw.size(), (uint32_t)tokens.texts.size());
+		tokens.texts.push_back(tokens.strings.intern(text));
+	}
+
+	// Value of c as a digit of bases up to 36, 36 for anything else
+	inline int digitValue(char c) {
+		if (CHAR_CLASSES.is(c, CHAR_DIGIT))
+			return c - '0';
+		if (CHAR_CLASSES.is(c, CHAR_ALPHA))
+			return (c | 0x20) - 'a' + 10;
+		return 36;
+	}
+
+	// Decodes the body of a string literal with escapes into text:
+	// \n \t \r, \xNN as a byte, \uXXXX as UTF-8, and like in char literals
+	// any other escaped character (\\ \" included) stands for itself.
+	// Returns the traceback message of a malformed escape.
+	inline const char* decodeEscapes(string_view raw, string& text) {
+		text.clear();
+		size_t i = 0;
+		while (true) {
+			size_t slash = raw.find('\\', i);
+			text.append(raw.data() + i, (slash == string_view::npos ? raw.size() : slash) - i);
+			if (slash == string_view::npos)
+				return nullptr;
+			// the lexer only ends a literal on a quote that is not escaped
+			char escaped = raw[slash + 1];
+			i = slash + 2;
+			switch (escaped) {
+			case 'n':
+				text += '\n'; break;
+			case 't':
+				text += '\t'; break;
+			case 'r':
+				text += '\r'; break;
+			case 'x':
+			case 'u': {
+				size_t count = escaped == 'x' ? 2 : 4;
+				uint32_t code = 0;
+				for (size_t k = 0; k < count; k++) {
+					int digit = i + k < raw.size() ? digitValue(raw[i + k]) : 16;
+					if (digit >= 16)
+						return escaped == 'x' ? "SyntaxError: invalid \\x escape" : "SyntaxError: invalid \\u escape";
+					code = code * 16 + digit;
+				}
+				i += count;
+				if (escaped == 'x')
+					text += (char)code;
+				else if (code >= 0xD800 && code <= 0xDFFF)
+					return "SyntaxError: invalid \\u escape";
+				else if (code < 0x80)
+					text += (char)code;
+				else if (code < 0x800) {
+					text += (char)(0xC0 | (code >> 6));
+					text += (char)(0x80 | (code & 0x3F));
+				}
+				else {
+					text += (char)(0xE0 | (code >> 12));
+					text += (char)(0x80 | ((code >> 6) & 0x3F));
+					text += (char)(0x80 | (code & 0x3F));
+				}
+				break;
+			}
+			default:
+				text += escaped;
+				break;
+			}
+		}
+	}
+
+	// Decimal digits, with '_' separators between them
+	template<typename Scan>
+	inline const char* decimalDigits(const char* p, const char* end) {
+		p = Scan::digits(p, end);
+		while (end - p >= 2 && *p == '_' && CHAR_CLASSES.is(p[1], CHAR_DIGIT))
+			p = Scan::digits(p + 1, end);
+		return p;
+	}
+
+	// Digits after a 0x / 0o / 0b prefix: at least one, all below base,
+	// every '_' followed by a digit
+	inline bool validDigits(string_view digits, int base) {
+		if (digits.empty())
+			return false;
+		for (size_t i = 0; i < digits.size(); i++) {
+			char c = digits[i];
+			if (c == '_') {
+				if (i + 1 == digits.size() || digits[i + 1] == '_')
+					return false;
+				continue;
+			}
+			if (digitValue(c) >= base)
+				return false;
+		}
+		return true;
+	}
+
+	// Decodes number literal digits (prefix removed, separators kept) with
+	// from_chars. Returns the traceback message when the value does not fit.
+	inline const char* decodeNumber(string_view digits, int base, bool is_float, NumberValue& value) {
+		string stripped;
+		if (digits.find('_') != string_view::npos) {
+			stripped.reserve(digits.size());
+			for (char c : digits)
+				if (c != '_')
+					stripped += c;
+			digits = stripped;
+		}
+		const char* first = digits.data();
+		const char* last = first + digits.size();
+		if (is_float) {
+			double real;
+			from_chars_result res = from_chars(first, last, real);
+			if (res.ec != errc() || res.ptr != last)
+				return "OverflowError: float literal out of range";
+			value = NumberValue::ofFloat(real);
+		}
+		else {
+			uint64_t integer;
+			from_chars_result res = from_chars(first, last, integer, base);
+			if (res.ec != errc() || res.ptr != last)
+				return "OverflowError: integer literal too large";
+			value = NumberValue::ofInteger(integer);
+		}
+		return nullptr;
+	}
+
+	// Perfect hash over KEYWORDS, built at compile time: a seed is searched
+	// until every keyword lands in its own slot, so a lookup is one hash,
+	// one table load and one compare. Only the length and the first, middle
+	// and last bytes are hashed, which keeps identifier scanning cheap.
+	struct KeywordHash {
+		static constexpr size_t SLOT_BITS = 7;
+		static constexpr size_t SLOTS = size_t(1) << SLOT_BITS;
+		static constexpr uint8_t EMPTY = 0xFF;
+
+		uint32_t seed = 0;
+		size_t min_length = SIZE_MAX;
+		size_t max_length = 0;
+		uint8_t slots[SLOTS] = {};
+
+		static constexpr uint32_t hash(const char* text, size_t length, uint32_t seed) {
+			uint32_t h = seed ^ ((uint32_t)length * 0x9E3779B1u);
+			h = (h ^ (uint8_t)text[0]) * 0x01000193u;
+			h = (h ^ (uint8_t)text[length / 2]) * 0x01000193u;
+			h = (h ^ (uint8_t)text[length - 1]) * 0x01000193u;
+			return (h ^ (h >> 15)) & (SLOTS - 1);
+		}
+
+		static constexpr KeywordHash build() {
+			KeywordHash table;
+			for (const Keyword& keyword : KEYWORDS) {
+				if (keyword.text.size() < table.min_length) table.min_length = keyword.text.size();
+				if (keyword.text.size() > table.max_length) table.max_length = keyword.text.size();
+			}
+			for (uint32_t seed = 1; seed < 100000; seed++) {
+				for (size_t i = 0; i < SLOTS; i++)
+					table.slots[i] = EMPTY;
+				bool collision = false;
+				for (SymbolId id = 0; id < KEYWORD_COUNT && !collision; id++) {
+					uint32_t slot = hash(KEYWORDS[id].text.data(), KEYWORDS[id].text.size(), seed);
+					if (table.slots[slot] != EMPTY)
+						collision = true;
+					table.slots[slot] = (uint8_t)id;
+				}
+				if (!collision) {
+					table.seed = seed;
+					return table;
+				}
+			}
+			table.seed = 0;
+			return table;
+		}
+
+		constexpr SymbolId find(const char* text, size_t length) const {
+			if (length < min_length || length > max_length)
+				return NO_SYMBOL;
+			uint8_t id = slots[hash(text, length, seed)];
+			if (id == EMPTY || KEYWORDS[id].text.size() != length)
+				return NO_SYMBOL;
+			for (size_t i = 0; i < length; i++)
+				if (KEYWORDS[id].text[i] != text[i])
+					return NO_SYMBOL;
+			return id;
+		}
+	};
+	static_assert(KEYWORD_COUNT < KeywordHash::EMPTY, "KEYWORDS does not fit the keyword hash slots");
+	inline constexpr KeywordHash KEYWORD_HASH = KeywordHash::build();
+	static_assert(KEYWORD_HASH.seed != 0, "No perfect hash seed for KEYWORDS, hash more bytes in KeywordHash::hash");
+
+	// Fixed symbol id of a keyword, type or bool literal, NO_SYMBOL otherwise
+	inline SymbolId keywordSymbol(const char* text, size_t length) {
+		return KEYWORD_HASH.find(text, length);
+	}
+	inline SymbolId keywordSymbol(string_view lexeme) {
+		return KEYWORD_HASH.find(lexeme.data(), lexeme.size());
+	}
+
+	TokenType handleKeyword(string_view lexeme) {
+		SymbolId id = keywordSymbol(lexeme);
+		if (id != NO_SYMBOL)
+			return KEYWORDS[id].type;
 		return TokenType::Identifier;
 	}
 
-	NONE_OR_TRACEBACK tokenize(string& source, vector<Token>& tokens) {
+	// Indentation of a line start, recorded instead of applied when
+	// chunks are lexed independently (see parallel_tokenizer.hpp)
+	struct IndentMark {
+		size_t token_index;		// tokens emitted before the line
+		size_t width;
+		size_t line;
+		size_t column;
+		size_t offset;			// start of the indentation
+	};
+
+	// Indentation widths of the open blocks, innermost on top. The first
+	// INLINE_DEPTH levels are stored in place, so a lexer state allocates
+	// nothing for files nested less deeply.
+	class IndentStack {
+	public:
+		static constexpr size_t INLINE_DEPTH = 16;
+
+		void push(size_t width) {
+			if (count < INLINE_DEPTH)
+				widths[count] = width;
+			else
+				deeper.push_back(width);
+			count++;
+		}
+		void pop() {
+			count--;
+			if (count >= INLINE_DEPTH)
+				deeper.pop_back();
+		}
+		size_t top() const {
+			return count <= INLINE_DEPTH ? widths[count - 1] : deeper.back();
+		}
+		size_t size() const {
+			return count;
+		}
+		bool empty() const {
+			return count == 0;
+		}
+		bool operator==(const IndentStack& other) const {
+			return count == other.count && equal(widths, widths + min(count, INLINE_DEPTH), other.widths)
+				&& deeper == other.deeper;
+		}
+		bool operator!=(const IndentStack& other) const {
+			return !(*this == other);
+		}
+
+	private:
+		size_t widths[INLINE_DEPTH] = {};
+		vector<size_t> deeper;
+		size_t count = 0;
+	};
+
+	// Everything the lexer carries from one token to the next, so lexing
+	// can stop at any token boundary and resume on a later buffer
+	struct LexState {
 		size_t current = 0;
 		size_t line = 1;
-		stack<size_t> indentStack;
-		indentStack.push(0);
-
-		bool handle_LF = true;
 		size_t line_start = 0;
+		bool handle_LF = true;
+		IndentStack indentStack;
+		vector<IndentMark>* indent_marks = nullptr;	// set: defer indentation to the caller
+		StringArena* strings = nullptr;		// decoded string literals of TokenView tokens
+
+		LexState() {
+			indentStack.push(0);
+		}
+	};
+
+	// Emits the INDENT/DEDENT tokens for a line indented by width
+	template<typename Tokens>
+	NONE_OR_TRACEBACK checkIndent(IndentStack& indentStack, Tokens& tokens, size_t width,
+				string_view indentation, size_t line, size_t column) {
+		if (width > indentStack.top()) {
+			indentStack.push(width);
+			addIndent(tokens, line, column, width);
+		}
+		else {
+			while (width < indentStack.top()) {
+				indentStack.pop();
+				addToken(tokens, TokenType::DEDENT, "", line, column);
+			}
+			if (width != indentStack.top()) {
+				addToken(tokens, TokenType::UNKNOWN, indentation, line, column);
+				return NONE_OR_TRACEBACK({ line, column, "IndentationError: unindent does not match any outer indentation level" }, TRACEBACK_ERROR);
+			}
+		}
+		return NONE_OR_TRACEBACK(0);
+	}
+
+	// Parts of the lexer a profiling Stats policy times (see lex_stats.hpp).
+	// Spaces, comments and newlines are what is left of the total.
+	enum class LexPhase : uint8_t {
+		Indentation,
+		Identifiers,
+		Literals,
+		Operators,
+	};
+	inline constexpr size_t LEX_PHASE_COUNT = 4;
+
+	// Stats policy of the lexer: a Scope lives while one phase runs. This
+	// one does nothing, so a lexer instantiated with it is the plain lexer.
+	struct NoLexStats {
+		struct Scope {
+			Scope(NoLexStats&, LexPhase) {}
+		};
+	};
 
-		while (current < source.length()) {
+	// Lexer body, instantiated once per scan kernel set (see scan.hpp) and
+	// Stats policy. Lexes the tokens starting before limit; a token may read
+	// past limit, up to the end of source, so limit must not cut a line short.
+	template<typename Scan, typename Tokens, typename Stats>
+	NONE_OR_TRACEBACK lexUntil(LexState& state, string_view source, size_t limit,
+				Tokens& tokens, SymbolTable* symbols, Stats& stats) {
+		const char* const data = source.data();
+		const char* const end = data + source.length();
+		size_t current = state.current;
+		size_t line = state.line;
+		size_t line_start = state.line_start;
+		bool handle_LF = state.handle_LF;
+		IndentStack& indentStack = state.indentStack;
+		// written back on every exit, the locals stay in registers meanwhile
+		struct SaveState {
+			LexState& state;
+			size_t& current;
+			size_t& line;
+			size_t& line_start;
+			bool& handle_LF;
+			~SaveState() {
+				state.current = current;
+				state.line = line;
+				state.line_start = line_start;
+				state.handle_LF = handle_LF;
+			}
+		} save = { state, current, line, line_start, handle_LF };
+		string decoded;		// string literal with its escapes decoded
+
+		while (current < limit) {
 			size_t tok_start = current;
 			size_t column = current - line_start + 1;
 			char c = source[current];
 
 			if (handle_LF) {
-				size_t curr_indent = 0;
+				typename Stats::Scope scope(stats, LexPhase::Indentation);
 				// handle indents
-				while (current < source.length() && source[current] == ' ') {
-					curr_indent++;
-					current++;
-				}
+				size_t curr_indent = Scan::spaces(data + current, end) - (data + current);
+				current += curr_indent;
 
 				// skip empty lines and comments
 				if (current < source.length() &&
@@ -128,14 +944,14 @@ namespace _pyrope {
 					if (source[current] == '\n') {
 						line++;
 						line_start = current++;
+						addLine(tokens, line_start);
 					}
 					else {
-						while (current < source.length() && source[current] != '\n') {
-							current++;
-						}
+						current = Scan::newline(data + current, end) - data;
 						if (current < source.length() && source[current] == '\n') {
 							line++;
 							line_start = current++;
+							addLine(tokens, line_start);
 						}
 					}
 					handle_LF = true;
@@ -143,19 +959,14 @@ namespace _pyrope {
 				}
 
 				// Check indents
-				if (curr_indent > indentStack.top()) {
-					indentStack.push(curr_indent);
-					addToken(tokens, TokenType::INDENT, "", line, column);
+				if (state.indent_marks != nullptr) {
+					state.indent_marks->push_back({ tokens.size(), curr_indent, line, column, tok_start });
 				}
 				else {
-					while (curr_indent < indentStack.top()) {
-						indentStack.pop();
-						addToken(tokens, TokenType::DEDENT, "", line, column);
-					}
-					if (curr_indent != indentStack.top()) {
-						addToken(tokens, TokenType::UNKNOWN, source.substr(tok_start, current - tok_start), line, column);
-						return NONE_OR_TRACEBACK({ line, column, "IndentationError: unindent does not match any outer indentation level" }, TRACEBACK_ERROR);
-					}
+					NONE_OR_TRACEBACK res = checkIndent(indentStack, tokens, curr_indent,
+						source.substr(tok_start, current - tok_start), line, column);
+					if (res.is_traceback)
+						return res;
 				}
 				handle_LF = false;
 				if (current >= source.length())
@@ -167,14 +978,12 @@ namespace _pyrope {
 			}
 
 			// skip spaces and comments
-			if (isspace(c) && c != '\n') {
+			if (c != '\n' && CHAR_CLASSES.is(c, CHAR_SPACE)) {
 				current++;
 				continue;
 			}
 			if (c == '#') {
-				while (current < source.length() && source[current] != '\n') {
-					current++;
-				}
+				current = Scan::newline(data + current, end) - data;
 				continue;
 			}
 			if (c == '\n') {
@@ -182,59 +991,87 @@ namespace _pyrope {
 				current++;
 				line++;
 				line_start = current;
+				addLine(tokens, line_start);
 				handle_LF = true;
 				continue;
 			}
 
 			// recognize tokens
 			// indentifiers & keywords
-			if (isalpha(c) || c == '_') {
-				while (current < source.length() &&
-					(isalnum(source[current]) || source[current] == '_')) {
-					current++;
-				}
-				string lexeme = source.substr(tok_start, current - tok_start);
-				TokenType type = handleKeyword(lexeme);
-				addToken(tokens, type, lexeme, line, column);
+			if (CHAR_CLASSES.is(c, CHAR_ALPHA) || c == '_') {
+				typename Stats::Scope scope(stats, LexPhase::Identifiers);
+				current = Scan::identifier(data + current, end) - data;
+				string_view lexeme = source.substr(tok_start, current - tok_start);
+				SymbolId symbol = keywordSymbol(lexeme);
+				TokenType type = TokenType::Identifier;
+				if (symbol != NO_SYMBOL)
+					type = KEYWORDS[symbol].type;
+				else if (symbols)
+					symbol = symbols->intern(lexeme);
+				addToken(tokens, type, lexeme, line, column, symbol);
 				continue;
 			}
 
-			// number literals
-			if (isdigit(c)) {
-				// TODO: hex, octal, binary
-				while (current < source.length() &&
-					isdigit(source[current])) {
-					current++;
+			// number literals: decimal, or 0x / 0o / 0b and digits of the base
+			if (CHAR_CLASSES.is(c, CHAR_DIGIT)) {
+				typename Stats::Scope scope(stats, LexPhase::Literals);
+				int base = 10;
+				if (c == '0' && current + 1 < source.length()) {
+					char prefix = source[current + 1] | 0x20;
+					base = prefix == 'x' ? 16 : prefix == 'o' ? 8 : prefix == 'b' ? 2 : 10;
 				}
-				if (current < source.length() && source[current] == '.') {
-					if (current + 1 < source.length()
-						&& isdigit(source[current + 1])) {
-						// float literal
-						current++;
-						while (current < source.length() && isdigit(source[current])) {
-							current++;
+				TokenType type = TokenType::LiteralNumber;
+				NumberValue value;
+				const char* error;
+				if (base != 10) {
+					// the whole run of name characters, so a digit out of the base is an error
+					current = Scan::identifier(data + current + 2, end) - data;
+					string_view digits = source.substr(tok_start + 2, current - tok_start - 2);
+					if (!validDigits(digits, base))
+						error = base == 16 ? "SyntaxError: invalid hexadecimal literal"
+							: base == 8 ? "SyntaxError: invalid octal literal" : "SyntaxError: invalid binary literal";
+					else
+						error = decodeNumber(digits, base, false, value);
+				}
+				else {
+					current = decimalDigits<Scan>(data + current, end) - data;
+					if (current < source.length() && source[current] == '.') {
+						if (current + 1 < source.length()
+							&& CHAR_CLASSES.is(source[current + 1], CHAR_DIGIT)) {
+							// float literal
+							current = decimalDigits<Scan>(data + current + 1, end) - data;
+							type = TokenType::LiteralFloat;
+						}
+						else {
+							// this may be .method() call
 						}
-						string lexeme = source.substr(tok_start, current - tok_start);
-						addToken(tokens, TokenType::LiteralFloat, lexeme, line, column);
-						continue;
-					}
-					else {
-						// this may be .method() call
 					}
+					error = decodeNumber(source.substr(tok_start, current - tok_start), 10,
+						type == TokenType::LiteralFloat, value);
+				}
+				string_view lexeme = source.substr(tok_start, current - tok_start);
+				if (error != nullptr) {
+					addToken(tokens, TokenType::UNKNOWN, lexeme, line, column);
+					return NONE_OR_TRACEBACK({ line, column, error }, TRACEBACK_ERROR);
 				}
-				string lexeme = source.substr(tok_start, current - tok_start);
-				addToken(tokens, TokenType::LiteralNumber, lexeme, line, column);
+				addNumber(tokens, type, lexeme, line, column, value);
 				continue;
 			}
 
 			// string literals
 			if (c == '"') {
+				typename Stats::Scope scope(stats, LexPhase::Literals);
 				current++;
 				tok_start++;
-				while (current < source.length() && source[current] != '"') {
+				bool escaped = false;
+				while (true) {
+					current = Scan::stringBody(data + current, end) - data;
+					if (current >= source.length() || source[current] == '"')
+						break;
 					if (source[current] == '\\') {
+						escaped = true;
 						current++;
-						if (current > source.length()) break;
+						if (current >= source.length()) break;
 					}
 					if (source[current] == '\n') {
 						addToken(tokens, TokenType::UNKNOWN, source.substr(tok_start, current - tok_start), line, column);
@@ -246,14 +1083,25 @@ namespace _pyrope {
 					addToken(tokens, TokenType::UNKNOWN, source.substr(tok_start, current - tok_start), line, column);
 					return NONE_OR_TRACEBACK({ line, column, "SyntaxError: Unterminated string literal" }, TRACEBACK_ERROR);
 				}
-				string lexeme = source.substr(tok_start, current - tok_start);
+				string_view lexeme = source.substr(tok_start, current - tok_start);
 				current++;
-				addToken(tokens, TokenType::LiteralString, lexeme, line, column);
+				if (!escaped) {
+					// the common case stays a view into the source
+					addToken(tokens, TokenType::LiteralString, lexeme, line, column);
+					continue;
+				}
+				const char* error = decodeEscapes(lexeme, decoded);
+				if (error != nullptr) {
+					addToken(tokens, TokenType::UNKNOWN, lexeme, line, column);
+					return NONE_OR_TRACEBACK({ line, column, error }, TRACEBACK_ERROR);
+				}
+				addString(tokens, lexeme, decoded, line, column, state.strings);
 				continue;
 			}
 
 			// char literals
 			if (c == '\'') {
+				typename Stats::Scope scope(stats, LexPhase::Literals);
 				current++;
 				tok_start++;
 				char char_val = '\0';
@@ -299,8 +1147,7 @@ namespace _pyrope {
 
 				if (current < source.length() && source[current] == '\'') {
 					current++;
-					string lexeme(1, char_val);
-					addToken(tokens, TokenType::LiteralChar, lexeme, line, column);
+					addToken(tokens, TokenType::LiteralChar, CHAR_LEXEMES[char_val], line, column);
 				}
 				else {
 					addToken(tokens, TokenType::UNKNOWN, source.substr(tok_start, current - tok_start), line, column);
@@ -309,177 +1156,325 @@ namespace _pyrope {
 				continue;
 			}
 
-			// check operators
-			if (source.substr(current, 3) == "//=") {
-				addToken(tokens, TokenType::Assignment, "//=", line, column); current += 3; continue;
-			}
-			if (source.substr(current, 3) == "**=") {
-				addToken(tokens, TokenType::Assignment, "**=", line, column); current += 3; continue;
-			}
-			if (source.substr(current, 2) == "//") {
-				addToken(tokens, TokenType::Operator, "//", line, column); current += 2; continue;
-			}
-			if (source.substr(current, 2) == "**") {
-				addToken(tokens, TokenType::Operator, "**", line, column); current += 2; continue;
-			}
-			if (source.substr(current, 2) == "&=") {
-				addToken(tokens, TokenType::Assignment, "&=", line, column); current += 2; continue;
-			}
-			if (source.substr(current, 2) == "+=") {
-				addToken(tokens, TokenType::Assignment, "+=", line, column); current += 2; continue;
-			}
-			if (source.substr(current, 2) == "-=") {
-				addToken(tokens, TokenType::Assignment, "-=", line, column); current += 2; continue;
-			}
-			if (source.substr(current, 2) == "*=") {
-				addToken(tokens, TokenType::Assignment, "*=", line, column); current += 2; continue;
-			}
-			if (source.substr(current, 2) == "/=") {
-				addToken(tokens, TokenType::Assignment, "/=", line, column); current += 2; continue;
-			}
-			if (source.substr(current, 2) == "%=") {
-				addToken(tokens, TokenType::Assignment, "%=", line, column); current += 2; continue;
-			}
-			if (source.substr(current, 2) == "->") {
-				addToken(tokens, TokenType::Follow, "->", line, column); current += 2; continue;
-			}
-			if (source.substr(current, 2) == "==") {
-				addToken(tokens, TokenType::Operator, "==", line, column); current += 2; continue;
-			}
-			if (source.substr(current, 2) == "!=") {
-				addToken(tokens, TokenType::Operator, "!=", line, column); current += 2; continue;
-			}
-			if (source.substr(current, 2) == "&&") {
-				addToken(tokens, TokenType::Operator, "&&", line, column); current += 2; continue;
-			}
-			if (source.substr(current, 2) == "||") {
-				addToken(tokens, TokenType::Operator, "||", line, column); current += 2; continue;
-			}
-			if (source.substr(current, 2) == ">=") {
-				addToken(tokens, TokenType::Operator, ">=", line, column); current += 2; continue;
-			}
-			if (source.substr(current, 2) == "<=") {
-				addToken(tokens, TokenType::Operator, "<=", line, column); current += 2; continue;
-			}
-			switch (c) {
-			case '+':
-				addToken(tokens, TokenType::Operator, "+", line, column); current++; continue;
-			case '-':
-				addToken(tokens, TokenType::Operator, "-", line, column); current++; continue;
-			case '*':
-				addToken(tokens, TokenType::Operator, "*", line, column); current++; continue;
-			case '/':
-				addToken(tokens, TokenType::Operator, "/", line, column); current++; continue;
-			case '%':
-				addToken(tokens, TokenType::Operator, "%", line, column); current++; continue;
-			case '=':
-				addToken(tokens, TokenType::Assignment, "=", line, column); current++; continue;
-			case ';':
-				addToken(tokens, TokenType::Punctuator, ";", line, column); current++; continue;
-			case ':':
-				addToken(tokens, TokenType::Punctuator, ":", line, column); current++; continue;
-			case '.':
-				addToken(tokens, TokenType::Punctuator, ".", line, column); current++; continue;
-			case ',':
-				addToken(tokens, TokenType::Punctuator, ",", line, column); current++; continue;
-			case '[':
-				addToken(tokens, TokenType::Punctuator, "[", line, column); current++; continue;
-			case ']':
-				addToken(tokens, TokenType::Punctuator, "]", line, column); current++; continue;
-			case '(':
-				addToken(tokens, TokenType::Punctuator, "(", line, column); current++; continue;
-			case ')':
-				addToken(tokens, TokenType::Punctuator, ")", line, column); current++; continue;
-			case '>':
-				addToken(tokens, TokenType::Operator, ">", line, column); current++; continue;
-			case '<':
-				addToken(tokens, TokenType::Operator, "<", line, column); current++; continue;
-			case '&':
-				addToken(tokens, TokenType::Operator, "&", line, column); current++; continue;
-			case '^':
-				addToken(tokens, TokenType::Operator, "^", line, column); current++; continue;
-			case '|':
-				addToken(tokens, TokenType::Operator, "|", line, column); current++; continue;
+			// operators and punctuators, longest match
+			{
+				typename Stats::Scope scope(stats, LexPhase::Operators);
+				OperatorDFA::Match op = OPERATOR_DFA.match(data + current, end);
+				if (op.length > 0) {
+					addToken(tokens, OPERATORS[op.op].type, source.substr(current, op.length), line, column);
+					current += op.length;
+					continue;
+				}
 			}
 
 			if (current == tok_start) {
-				addToken(tokens, TokenType::UNKNOWN, string(1, c), line, column);
+				addToken(tokens, TokenType::UNKNOWN, source.substr(current, 1), line, column);
 				return NONE_OR_TRACEBACK({ line, column, "SyntaxError: Unexpected character" }, TRACEBACK_ERROR);
 			}
 		}
 
-		size_t final_column = current - line_start + 1;
-		while (indentStack.top() > 0) {
-			indentStack.pop();
-			addToken(tokens, TokenType::DEDENT, "", line, final_column);
+		return NONE_OR_TRACEBACK(0);
+	}
+
+	template<typename Scan, typename Tokens>
+	NONE_OR_TRACEBACK lexUntil(LexState& state, string_view source, size_t limit,
+				Tokens& tokens, SymbolTable* symbols) {
+		NoLexStats stats;
+		return lexUntil<Scan>(state, source, limit, tokens, symbols, stats);
+	}
+
+	// Closes open blocks and ends the stream once the source is exhausted
+	template<typename Tokens>
+	void lexFinish(LexState& state, Tokens& tokens) {
+		size_t final_column = state.current - state.line_start + 1;
+		while (state.indentStack.top() > 0) {
+			state.indentStack.pop();
+			addToken(tokens, TokenType::DEDENT, "", state.line, final_column);
 		}
-		if (!handle_LF) {
-			addToken(tokens, TokenType::NEWLINE, "\\n", line, final_column);
+		if (!state.handle_LF) {
+			addToken(tokens, TokenType::NEWLINE, "\\n", state.line, final_column);
 		}
-		addToken(tokens, TokenType::END_OF_FILE, "", line, final_column);
+		addToken(tokens, TokenType::END_OF_FILE, "", state.line, final_column);
+	}
 
-		return NONE_OR_TRACEBACK(0);
+	// Skips the rest of the line an error was found on, so a recovering pass
+	// goes on with the next one. The broken line, which ends with the
+	// UNKNOWN token of the error, still gets its NEWLINE.
+	template<typename Tokens>
+	void lexResync(LexState& state, string_view source, Tokens& tokens) {
+		size_t newline = source.find('\n', state.current);
+		size_t line_end = newline == string_view::npos ? source.length() : newline;
+		addToken(tokens, TokenType::NEWLINE, "\\n", state.line, line_end - state.line_start + 1);
+		state.handle_LF = true;
+		if (newline == string_view::npos) {
+			state.current = source.length();
+			return;
+		}
+		state.current = newline + 1;
+		state.line++;
+		state.line_start = state.current;
+		addLine(tokens, state.line_start);
+	}
+
+	// TokenView tokens keep their decoded string literals in the StringArena
+	// of the compilation; other tokens keep them themselves
+	template<typename TokenT>
+	inline constexpr bool KEEPS_DECODED_STRINGS = !is_same_v<TokenT, TokenView>;
+
+	// Without diagnostics lexing stops at the first error. With them every
+	// error is reported and lexing resumes on the next line; the result is
+	// still the first error. strings is where TokenView tokens keep decoded
+	// string literals.
+	template<typename Scan, typename Tokens, typename Stats = NoLexStats>
+	NONE_OR_TRACEBACK tokenizeWith(string_view source, Tokens& tokens, SymbolTable* symbols,
+				Diagnostics* diagnostics = nullptr, Stats* stats = nullptr, StringArena* strings = nullptr) {
+		NoLexStats none;
+		if constexpr (is_same_v<Stats, NoLexStats>)
+			stats = &none;
+		LexState state;
+		state.strings = strings;
+		NONE_OR_TRACEBACK res = lexUntil<Scan>(state, source, source.length(), tokens, symbols, *stats);
+		if (res.is_traceback) {
+			if (diagnostics == nullptr)
+				return res;
+			NONE_OR_TRACEBACK next = res;
+			do {
+				diagnostics->report(next.error);
+				lexResync(state, source, tokens);
+				next = lexUntil<Scan>(state, source, source.length(), tokens, symbols, *stats);
+			} while (next.is_traceback);
+		}
+		lexFinish(state, tokens);
+		return res;
+	}
+
+	template<typename Tokens, typename Stats = NoLexStats>
+	NONE_OR_TRACEBACK tokenizeInto(string_view source, Tokens& tokens, SymbolTable* symbols,
+				Diagnostics* diagnostics = nullptr, Stats* stats = nullptr, StringArena* strings = nullptr) {
+		switch (activeScanLevel().load(memory_order_relaxed)) {
+#ifdef PYROPE_SCAN_X86
+		case ScanLevel::AVX2:
+			return tokenizeWith<Avx2Scan>(source, tokens, symbols, diagnostics, stats, strings);
+		case ScanLevel::SSE2:
+			return tokenizeWith<Sse2Scan>(source, tokens, symbols, diagnostics, stats, strings);
+#endif
+		default:
+			return tokenizeWith<ScalarScan>(source, tokens, symbols, diagnostics, stats, strings);
+		}
+	}
+
+	// Tokens are written through addToken, so TokenT selects between
+	// owned lexemes (Token) and views into source (TokenView).
+	// With a symbol table every name is interned and tokens carry its id,
+	// without one only keywords, types and bool literals get their fixed id.
+	template<typename TokenT>
+	NONE_OR_TRACEBACK tokenize(string_view source, vector<TokenT>& tokens, SymbolTable* symbols = nullptr) {
+		static_assert(KEEPS_DECODED_STRINGS<TokenT>, "TokenView tokens need a StringArena for decoded string literals");
+		return tokenizeInto(source, tokens, symbols);
+	}
+
+	template<typename TokenT>
+	NONE_OR_TRACEBACK tokenize(string_view source, vector<TokenT>& tokens, SymbolTable& symbols) {
+		return tokenize<TokenT>(source, tokens, &symbols);
+	}
+
+	// Decoded string literals go to strings, the arena of the compilation,
+	// which must outlive the tokens. Literals without escapes stay views
+	// into source.
+	NONE_OR_TRACEBACK tokenize(string_view source, vector<TokenView>& tokens, StringArena& strings,
+				SymbolTable* symbols = nullptr) {
+		return tokenizeInto<vector<TokenView>, NoLexStats>(source, tokens, symbols, nullptr, nullptr, &strings);
 	}
+
+	NONE_OR_TRACEBACK tokenize(string& source, vector<Token>& tokens) {
+		return tokenize<Token>(string_view(source), tokens);
+	}
+
+	// Replaces the contents of tokens with the tokens of source
+	NONE_OR_TRACEBACK tokenize(string_view source, TokenBuffer& tokens, SymbolTable* symbols = nullptr) {
+		tokens.reset(source);
+		return tokenizeInto(source, tokens, symbols);
+	}
+	NONE_OR_TRACEBACK tokenize(string_view source, TokenBuffer& tokens, SymbolTable& symbols) {
+		return tokenize(source, tokens, &symbols);
+	}
+
+	// Recovering tokenize: every error goes to diagnostics, the line it is on
+	// ends at the error and lexing goes on with the next line, so all errors
+	// of a file come out of one pass. Returns the first error.
+	template<typename TokenT>
+	NONE_OR_TRACEBACK tokenizeAll(string_view source, vector<TokenT>& tokens, Diagnostics& diagnostics,
+				SymbolTable* symbols = nullptr) {
+		static_assert(KEEPS_DECODED_STRINGS<TokenT>, "TokenView tokens need a StringArena for decoded string literals");
+		return tokenizeInto(source, tokens, symbols, &diagnostics);
+	}
+	NONE_OR_TRACEBACK tokenizeAll(string_view source, vector<TokenView>& tokens, Diagnostics& diagnostics,
+				StringArena& strings, SymbolTable* symbols = nullptr) {
+		return tokenizeInto<vector<TokenView>, NoLexStats>(source, tokens, symbols, &diagnostics, nullptr, &strings);
+	}
+	NONE_OR_TRACEBACK tokenizeAll(string_view source, TokenBuffer& tokens, Diagnostics& diagnostics,
+				SymbolTable* symbols = nullptr) {
+		tokens.reset(source);
+		return tokenizeInto(source, tokens, symbols, &diagnostics);
+	}
+
+	// Pull-based lexer over chunked input. Input is read on demand and only
+	// the unfinished line is kept, so memory is bounded by the longest line
+	// (plus one chunk) instead of the whole source, and tokens can be consumed
+	// while the rest of the input is still being read.
+	class Lexer {
+	public:
+		// Fills buffer with up to capacity bytes, returns 0 at end of input
+		typedef function<size_t(char* buffer, size_t capacity)> Reader;
+
+		static constexpr size_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+
+		Lexer(Reader reader, SymbolTable* symbols = nullptr, size_t chunk_size = DEFAULT_CHUNK_SIZE)
+			: reader(move(reader)), symbols(symbols), chunk_size(chunk_size > 0 ? chunk_size : 1) {
+			switch (activeScanLevel().load(memory_order_relaxed)) {
+#ifdef PYROPE_SCAN_X86
+			case ScanLevel::AVX2:
+				lex = &lexUntil<Avx2Scan, vector<Token>>; break;
+			case ScanLevel::SSE2:
+				lex = &lexUntil<Sse2Scan, vector<Token>>; break;
+#endif
+			default:
+				lex = &lexUntil<ScalarScan, vector<Token>>; break;
+			}
+		}
+		Lexer(istream& in, SymbolTable* symbols = nullptr, size_t chunk_size = DEFAULT_CHUNK_SIZE)
+			: Lexer([&in](char* buffer, size_t capacity) -> size_t {
+				in.read(buffer, (streamsize)capacity);
+				return (size_t)in.gcount();
+			}, symbols, chunk_size) {}
+
+		// Next token; false after END_OF_FILE has been returned, or on an error
+		// (reported by status() once the tokens before it have been consumed)
+		bool next(Token& token) {
+			while (pending_pos == pending.size()) {
+				if (done)
+					return false;
+				pending.clear();
+				pending_pos = 0;
+				advance();
+			}
+			token = move(pending[pending_pos++]);
+			return true;
+		}
+
+		const NONE_OR_TRACEBACK& status() const {
+			return result;
+		}
+
+	private:
+		// a char literal may hold a raw newline, so a line is only lexed once
+		// this many bytes after its '\n' are buffered too
+		static constexpr size_t LOOKAHEAD = 3;
+
+		Reader reader;
+		SymbolTable* symbols;
+		size_t chunk_size;
+		NONE_OR_TRACEBACK (*lex)(LexState&, string_view, size_t, vector<Token>&, SymbolTable*);
+
+		string buffer;
+		LexState state;
+		bool eof = false;
+		bool done = false;
+		NONE_OR_TRACEBACK result = NONE_OR_TRACEBACK(0);
+		vector<Token> pending;
+		size_t pending_pos = 0;
+
+		// End of the complete lines in buffer
+		size_t lexableLimit() const {
+			if (eof)
+				return buffer.size();
+			if (buffer.size() <= LOOKAHEAD)
+				return 0;
+			size_t newline = buffer.rfind('\n', buffer.size() - LOOKAHEAD - 1);
+			return newline == string::npos ? 0 : newline + 1;
+		}
+
+		void advance() {
+			// drop what no later token can refer to
+			size_t consumed = min(state.current, state.line_start);
+			buffer.erase(0, consumed);
+			state.current -= consumed;
+			state.line_start -= consumed;
+
+			size_t limit = lexableLimit();
+			while (limit <= state.current && !eof) {
+				size_t old_size = buffer.size();
+				buffer.resize(old_size + chunk_size);
+				size_t read = reader(&buffer[old_size], chunk_size);
+				buffer.resize(old_size + read);
+				if (read == 0)
+					eof = true;
+				limit = lexableLimit();
+			}
+
+			NONE_OR_TRACEBACK res = lex(state, buffer, limit, pending, symbols);
+			if (res.is_traceback) {
+				result = res;
+				done = true;
+				return;
+			}
+			if (eof && state.current >= buffer.size()) {
+				lexFinish(state, pending);
+				done = true;
+			}
+		}
+	};
 }
 
-using _pyrope::Token, _pyrope::TokenType, _pyrope::tokenize;
+using _pyrope::Token, _pyrope::TokenView, _pyrope::NumberKind, _pyrope::NumberValue, _pyrope::TokenBuffer, _pyrope::TokenType, _pyrope::Lexer, _pyrope::SymbolId, _pyrope::SymbolTable, _pyrope::StringArena, _pyrope::tokenize, _pyrope::tokenizeAll;
 
-ostream& operator<<(ostream& os, TokenType type) {
+const char* tokenTypeName(TokenType type) {
 	switch (type) {
 	case TokenType::Type:
-		os << "Type";
-		break;
+		return "Type";
 	case TokenType::Keyword:
-		os << "Keyword";
-		break;
+		return "Keyword";
 	case TokenType::Identifier:
-		os << "Identifier";
-		break;
+		return "Identifier";
 	case TokenType::LiteralString:
-		os << "LiteralString";
-		break;
+		return "LiteralString";
 	case TokenType::LiteralChar:
-		os << "LiteralChar";
-		break;
+		return "LiteralChar";
 	case TokenType::LiteralNumber:
-		os << "LiteralNumber";
-		break;
+		return "LiteralNumber";
 	case TokenType::LiteralFloat:
-		os << "LiteralFloat";
-		break;
+		return "LiteralFloat";
 	case TokenType::LiteralBool:
-		os << "LiteralBool";
-		break;
+		return "LiteralBool";
 	case TokenType::Operator:
-		os << "Operator";
-		break;
+		return "Operator";
 	case TokenType::Assignment:
-		os << "Assignment";
-		break;
+		return "Assignment";
 	case TokenType::Punctuator:
-		os << "Punctuator";
-		break;
+		return "Punctuator";
 	case TokenType::Follow:
-		os << "Follow";
-		break;
+		return "Follow";
 	case TokenType::INDENT:
-		os << "Indent";
-		break;
+		return "Indent";
 	case TokenType::DEDENT:
-		os << "Dedent";
-		break;
+		return "Dedent";
 	case TokenType::NEWLINE:
-		os << "Newline";
-		break;
+		return "Newline";
 	case TokenType::END_OF_FILE:
-		os << "EOF";
-		break;
+		return "EOF";
 	default:
-		os << "Unknown";
+		return "Unknown";
 	}
+}
+ostream& operator<<(ostream& os, TokenType type) {
+	os << tokenTypeName(type);
 	return os;
 }
 ostream& operator<<(ostream& os, const Token& token) {
 	os << token.line << ':' << token.column << '\t' << token.type << "\t\"" << token.lexeme << "\"";
 	return os;
 }
+ostream& operator<<(ostream& os, const TokenView& token) {
+	os << token.line << ':' << token.column << '\t' << token.type << "\t\"" << token.lexeme << "\"";
+	return os;
+}
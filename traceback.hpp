@@ -13,10 +13,20 @@
 */
 #pragma once
 
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <string>
+#include <string_view>
 #include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 using namespace std;
 
 namespace _pyrope {
+	// message is a literal or comes from internMessage, so a traceback is
+	// copied freely and never owns memory
 	struct TRACEBACK {
 		size_t line;
 		size_t column;
@@ -24,28 +34,159 @@ namespace _pyrope {
 	};
 
 	struct _tag_traceback {};
-	_tag_traceback TRACEBACK_ERROR;
+	inline constexpr _tag_traceback TRACEBACK_ERROR{};
+
+	// A stable copy of a message built at run time, such as one naming the
+	// offending token. Equal messages share one copy, kept until exit.
+	inline const char* internMessage(string_view message) {
+		static mutex lock;
+		static unordered_set<string>* messages = new unordered_set<string>();
+		lock_guard<mutex> hold(lock);
+		return messages->emplace(message).first->c_str();
+	}
+
+	// Storage of RTRACEBACK. Trivial value types keep it trivially copyable
+	// and destructible, so a result is returned like a plain struct; other
+	// ones get the constructors and destructor of a tagged union.
+	template<typename ReturnT, bool = is_trivially_copyable_v<ReturnT> && is_trivially_destructible_v<ReturnT>>
+	struct TracebackStorage {
+		union {
+			ReturnT value;
+			TRACEBACK error;
+		};
+		bool is_traceback;
+
+		TracebackStorage(ReturnT v) : value(v), is_traceback(false) {}
+		TracebackStorage(TRACEBACK e, _tag_traceback) : error(e), is_traceback(true) {}
+	};
 
 	template<typename ReturnT>
-	// Traceback error or return value
-	struct RTRACEBACK {
+	struct TracebackStorage<ReturnT, false> {
 		union {
 			ReturnT value;
 			TRACEBACK error;
 		};
 		bool is_traceback;
 
-		RTRACEBACK(ReturnT v) : value(v), is_traceback(false) {}
-		RTRACEBACK(TRACEBACK e, _tag_traceback) : error(e), is_traceback(true) {}
+		TracebackStorage(ReturnT v) : value(move(v)), is_traceback(false) {}
+		TracebackStorage(TRACEBACK e, _tag_traceback) : error(e), is_traceback(true) {}
+		TracebackStorage(const TracebackStorage& other) : is_traceback(other.is_traceback) {
+			if (is_traceback)
+				error = other.error;
+			else
+				new (&value) ReturnT(other.value);
+		}
+		TracebackStorage(TracebackStorage&& other) noexcept(is_nothrow_move_constructible_v<ReturnT>)
+			: is_traceback(other.is_traceback) {
+			if (is_traceback)
+				error = other.error;
+			else
+				new (&value) ReturnT(move(other.value));
+		}
+		TracebackStorage& operator=(const TracebackStorage& other) {
+			if (this == &other)
+				return *this;
+			if (other.is_traceback)
+				setError(other.error);
+			else if (is_traceback) {
+				new (&value) ReturnT(other.value);
+				is_traceback = false;
+			}
+			else
+				value = other.value;
+			return *this;
+		}
+		TracebackStorage& operator=(TracebackStorage&& other) noexcept(is_nothrow_move_constructible_v<ReturnT>
+			&& is_nothrow_move_assignable_v<ReturnT>) {
+			if (this == &other)
+				return *this;
+			if (other.is_traceback)
+				setError(other.error);
+			else if (is_traceback) {
+				new (&value) ReturnT(move(other.value));
+				is_traceback = false;
+			}
+			else
+				value = move(other.value);
+			return *this;
+		}
+		~TracebackStorage() {
+			if (!is_traceback)
+				value.~ReturnT();
+		}
+
+	private:
+		void setError(const TRACEBACK& e) {
+			if (!is_traceback)
+				value.~ReturnT();
+			error = e;
+			is_traceback = true;
+		}
+	};
+
+	template<typename ReturnT>
+	// Traceback error or return value
+	struct RTRACEBACK : TracebackStorage<ReturnT> {
+		using TracebackStorage<ReturnT>::TracebackStorage;
+
+		bool ok() const {
+			return !this->is_traceback;
+		}
+		// The value; only valid when ok()
+		ReturnT& operator*() & {
+			return this->value;
+		}
+		const ReturnT& operator*() const& {
+			return this->value;
+		}
+		ReturnT&& operator*() && {
+			return move(this->value);
+		}
+		ReturnT* operator->() {
+			return &this->value;
+		}
+		const ReturnT* operator->() const {
+			return &this->value;
+		}
 	};
 	typedef RTRACEBACK<bool>
 		NONE_OR_TRACEBACK;
+	static_assert(is_trivially_copyable_v<NONE_OR_TRACEBACK>, "the success path must stay a plain struct");
+
+	// Collects the errors of a recovering pass, in source order. Reporting
+	// stops at limit; the errors after it are only counted in dropped.
+	struct Diagnostics {
+		vector<TRACEBACK> errors;
+		size_t limit = SIZE_MAX;
+		size_t dropped = 0;
+
+		Diagnostics() {}
+		explicit Diagnostics(size_t limit) : limit(limit) {}
+
+		void report(const TRACEBACK& error) {
+			if (errors.size() < limit)
+				errors.push_back(error);
+			else
+				dropped++;
+		}
+		bool empty() const {
+			return errors.empty();
+		}
+		size_t size() const {
+			return errors.size() + dropped;
+		}
+		void clear() {
+			errors.clear();
+			dropped = 0;
+		}
+	};
 }
-using _pyrope::TRACEBACK, _pyrope::RTRACEBACK, _pyrope::TRACEBACK_ERROR, _pyrope::NONE_OR_TRACEBACK;
+using _pyrope::TRACEBACK, _pyrope::RTRACEBACK, _pyrope::TRACEBACK_ERROR, _pyrope::NONE_OR_TRACEBACK,
+	_pyrope::Diagnostics, _pyrope::internMessage;
 
 #include <iostream>
 
-ostream& operator<<(ostream& os, _pyrope::TRACEBACK tb) {
+inline ostream& operator<<(ostream& os, _pyrope::TRACEBACK tb) {
 	os << "Traceback(" << tb.message << " at line " << tb.line << " column " << tb.column << ')';
 	return os;
 }